@@ -14,6 +14,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "poll.h"
 
 static void consputc(int);
 
@@ -186,6 +187,8 @@ struct {
   uint e;  // Edit index
 } input;
 
+static struct pollq conspollq;  // pollers waiting for a line
+
 #define C(x)  ((x)-'@')  // Control-x
 
 void
@@ -221,6 +224,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          pollwake(&conspollq);
         }
       }
       break;
@@ -232,14 +236,36 @@ consoleintr(int (*getc)(void))
   }
 }
 
+// A line of input waits to be read?  Output never waits.
+int
+consolepoll(struct inode *ip)
+{
+  int r;
+
+  acquire(&cons.lock);
+  r = POLLOUT;
+  if(input.r != input.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
+// The process may have slept, and had its pages swapped
+// out, since the system call checked dst; so characters are
+// gathered in buf and copied out after cons.lock is released.
+// Reads at most a line buffer's worth.
 int
 consoleread(struct inode *ip, char *dst, int n)
 {
+  char buf[INPUT_BUF], *p;
   uint target;
   int c;
 
   iunlock(ip);
+  if(n > INPUT_BUF)
+    n = INPUT_BUF;
   target = n;
+  p = buf;
   acquire(&cons.lock);
   while(n > 0){
     while(input.r == input.w){
@@ -259,30 +285,44 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
-    *dst++ = c;
+    *p++ = c;
     --n;
     if(c == '\n')
       break;
   }
   release(&cons.lock);
+  c = target - n;
+  if(copyuser(myproc()->mm, (uint)dst, buf, c, 1) < 0)
+    c = -1;
   ilock(ip);
 
-  return target - n;
+  return c;
 }
 
+// buf is user memory, as for consoleread(), or kernel memory
+// from sendfile(); it is copied a piece at a time into b
+// before cons.lock is taken.
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
-  int i;
+  char b[64];
+  int i, j, m;
 
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(b) ? n - i : sizeof(b);
+    if((uint)buf >= KERNBASE)
+      memmove(b, buf + i, m);
+    else if(copyuser(myproc()->mm, (uint)buf + i, b, m, 0) < 0)
+      break;
+    acquire(&cons.lock);
+    for(j = 0; j < m; j++)
+      consputc(b[j] & 0xff);
+    release(&cons.lock);
+  }
   ilock(ip);
 
-  return n;
+  return i < n ? -1 : n;
 }
 
 void
@@ -292,6 +332,8 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
+  devsw[CONSOLE].pollq = &conspollq;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
@@ -0,0 +1,35 @@
+// Print per-CPU idle time and reschedule-IPI wakeup latency.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "cpustat.h"
+
+struct cpustat cs[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+  int n, i;
+  uint total;
+
+  n = cpustat(cs, NCPU);
+  if(n < 0){
+    printf(2, "cpustat: failed\n");
+    exit();
+  }
+  if(n > NCPU)
+    n = NCPU;
+  printf(1, "cpu  busy  idle  idle%%  wakeups  avg-wake  max-wake (cycles)\n");
+  for(i = 0; i < n; i++){
+    total = cs[i].busyticks + cs[i].idleticks;
+    printf(1, "%d  %d  %d  %d%%  %d  %d  %d\n", i,
+           cs[i].busyticks, cs[i].idleticks,
+           total ? cs[i].idleticks * 100 / total : 0,
+           cs[i].wakeups,
+           cs[i].wakeups ? cs[i].wakecycles / cs[i].wakeups : 0,
+           cs[i].maxwake);
+  }
+  exit();
+}
@@ -0,0 +1,8 @@
+// Per-CPU scheduler statistics, see cpustat().
+struct cpustat {
+  uint busyticks;   // clock ticks that found a process running
+  uint idleticks;   // clock ticks that found the CPU idle
+  uint wakeups;     // wakeups from halt by a reschedule IPI
+  uint wakecycles;  // total TSC cycles from IPI to scheduler
+  uint maxwake;     // longest of those
+};
@@ -2,13 +2,24 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct kinfo;
+struct lockstat;
 struct pipe;
+struct pollfd;
+struct pollq;
 struct proc;
+struct mm;
+struct files;
+struct pstat;
+struct ushare;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -31,8 +42,13 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filepoll(struct file*);
+struct pollq*   filepollq(struct file*);
+int             filereadv(struct file*, struct iovec*, int, int);
+int             filesend(struct file*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -42,6 +58,7 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -53,6 +70,11 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint, uint);
+int             futexwake(uint, int);
+
 // namecache.c
 void            namecache_init(void);
 uint            namecache_lookup(uint, uint, char*);
@@ -73,9 +95,12 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+void            kdup(char*);
 void            kfree(char*);
+int             krefcnt(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+extern uint     phystop;
 
 // kbd.c
 void            kbdintr(void);
@@ -85,8 +110,11 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(int, int);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+uint64          nanotime(void);
+extern uint     tsckhz;
 void            microdelay(int);
 
 // log.c
@@ -103,17 +131,33 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pagecache.c
+void            pcacheinit(void);
+char*           pcacheget(struct inode*, uint, int);
+void            pcacheupdate(struct inode*, uint, char*, uint);
+void            pcachedrop(struct inode*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             pipepoll(struct pipe*, int);
+struct pollq*   pipepollq(struct pipe*);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
+int             pipewritei(struct pipe*, struct file*, int, int);
+
+// poll.c
+void            pollinit(void);
+void            pollwake(struct pollq*);
+int             poll(struct pollfd*, int, int);
 
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
 void            exit(void);
+int             clone(uint, uint, uint);
 int             fork(void);
+struct files*   filesalloc(void);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
@@ -124,10 +168,28 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+int             sleeptimeout(void*, struct spinlock*, uint);
+int             swapout(void);
 void            userinit(void);
 int             wait(void);
+int             join(uint*);
+void            mmsingle(struct mm*);
 void            wakeup(void*);
+void            wakeupone(void*);
 void            yield(void);
+int             shouldyield(int);
+int             nice(int);
+int             getpinfo(struct pstat*, int, int);
+
+// swap.c
+char*           kallocswap(void);
+int             swapalloc(void);
+void            swapfree(uint);
+void            swapinit(void);
+void            swaplock(void);
+void            swapread(uint, char*);
+void            swapunlock(void);
+void            swapwrite(uint, char*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -137,14 +199,30 @@ void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockclass(char*, int);
+void            lockacquired(int, int, uint);
+void            lockreleased(int, uint);
+int             lockstat(struct lockstat*, int, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// share.c
+void            shareinit(void);
+uint            sharepass(int);
+int             sharepasses(int*, uint*, int);
+void            sharejoin(int);
+void            shareleave(int);
+void            sharecharge(int);
+int             setshares(int, int);
+int             getshares(struct ushare*, int);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+int             holdingsleepany(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -159,16 +237,23 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
+int             checkuser(uint, int, int);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            timeradd(struct timer*, uint);
+int             timerdel(struct timer*);
+void            timertick(void);
 
 // trap.c
 void            idtinit(void);
+extern struct kinfo *kinfo;
+void            sysenterinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
@@ -187,12 +272,28 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+int             copyuvm(pde_t*, pde_t*, uint, struct vma*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+struct vma*     vmalookup(struct mm*, uint);
+void            vmafree(struct vma*);
+int             pagefault(struct mm*, uint, int);
+int             copyuser(struct mm*, uint, char*, uint, int);
+uint            vmaalloc(struct mm*, uint, int, struct inode*, uint, uint);
+int             vmaunmap(struct mm*, uint, uint);
+uint            pagevictim(struct mm*, uint*, uint);
+void            unmapuvm(pde_t*, uint, uint);
+struct mm*      mmalloc(void);
+void            mmdup(struct mm*);
+void            uinfoset(struct proc*);
+void            mmexit(struct mm*);
+void            mmput(struct mm*);
+void            mmlock(struct mm*);
+void            mmunlock(struct mm*);
+void            tlbshootdown(struct mm*);
+void            tlbintr(void);
 
 // users.c
 void            users_init(void);
@@ -2,6 +2,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
@@ -16,9 +17,12 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  struct vma vma[NVMA], *v;
+  struct mm *mm, *oldmm;
+  pde_t *pgdir;
   struct proc *curproc = myproc();
 
+  memset(vma, 0, sizeof(vma));
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -26,8 +30,8 @@ exec(char *path, char **argv)
     cprintf("exec: fail\n");
     return -1;
   }
-  ilock(ip);
-  pgdir = 0;
+  ilockshared(ip);
+  mm = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -35,11 +39,14 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pgdir = setupkvm()) == 0)
+  if((mm = mmalloc()) == 0)
     goto bad;
+  pgdir = mm->pgdir;
 
-  // Load program into memory.
+  // Record the program's segments; pagefault() reads
+  // them in as the program touches them.
   sz = 0;
+  v = vma;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -49,12 +56,26 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.off + ph.filesz < ph.off)
+      goto bad;
+    if(ph.vaddr + ph.memsz >= MMAPBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr < sz)
+      goto bad;
+    if(ph.memsz == 0)
+      continue;
+    if(v == &vma[NVMA])
       goto bad;
+    v->start = ph.vaddr;
+    v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+    v->flags = (ph.flags & ELF_PROG_FLAG_WRITE) ? VMA_WRITE : 0;
+    v->ip = idup(ip);
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    sz = v->end;
+    v++;
   }
   iunlockput(ip);
   end_op();
@@ -93,22 +114,31 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  // Commit to the user image.  If this is a thread, the
+  // other threads keep the old memory.
+  memmove(mm->vma, vma, sizeof(vma));
+  mm->sz = sz;
+  oldmm = curproc->mm;
+  curproc->mm = mm;
+  curproc->thread = 0;
+  uinfoset(curproc);
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  mmexit(oldmm);
+  mmput(oldmm);
   return 0;
 
  bad:
-  if(pgdir)
-    freevm(pgdir);
-  if(ip){
-    iunlockput(ip);
-    end_op();
-  }
+  if(mm)
+    mmput(mm);
+  if(ip)
+    iunlock(ip);
+  else
+    begin_op();
+  vmafree(vma);
+  if(ip)
+    iput(ip);
+  end_op();
   return -1;
 }
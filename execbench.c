@@ -0,0 +1,89 @@
+// Time fork+exec+exit+wait of a few common programs.
+// Each child runs with stdin at end-of-file and its
+// output drained through a pipe, so the numbers are
+// dominated by the cost of starting the program.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define N 100
+
+char *shargv[] = { "sh", 0 };
+char *lsargv[] = { "ls", 0 };
+char *grepargv[] = { "grep", "xv6", "README", 0 };
+
+char buf[512];
+
+int
+run(char **argv)
+{
+  int in[2], out[2], pid;
+
+  if(pipe(in) < 0)
+    return -1;
+  if(pipe(out) < 0){
+    close(in[0]);
+    close(in[1]);
+    return -1;
+  }
+  pid = fork();
+  if(pid < 0)
+    return -1;
+  if(pid == 0){
+    close(0);
+    dup(in[0]);
+    close(1);
+    dup(out[1]);
+    close(2);
+    dup(out[1]);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    exec(argv[0], argv);
+    exit();
+  }
+  close(in[0]);
+  close(in[1]);
+  close(out[1]);
+  while(read(out[0], buf, sizeof(buf)) > 0)
+    ;
+  close(out[0]);
+  wait();
+  return 0;
+}
+
+void
+bench(char **argv, int n)
+{
+  int i;
+  uint start, end;
+
+  start = uptime();
+  for(i = 0; i < n; i++){
+    if(run(argv) < 0){
+      printf(1, "execbench: %s failed\n", argv[0]);
+      exit();
+    }
+  }
+  end = uptime();
+  printf(1, "%s: %d runs in %d ticks, %d.%d ticks per run\n", argv[0], n,
+         end - start, (end - start) / n, ((end - start) * 10 / n) % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = N;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1)
+    n = 1;
+  bench(shargv, n);
+  bench(lsargv, n);
+  bench(grepargv, n);
+  exit();
+}
@@ -2,3 +2,8 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x800  // read and write return -1 instead of waiting
+
+// fcntl() commands
+#define F_GETFL   1
+#define F_SETFL   2       // only O_NONBLOCK can change
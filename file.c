@@ -5,10 +5,16 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
 #include "fs.h"
+#include "mmu.h"
+#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "proc.h"
+#include "uio.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -32,6 +38,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -79,19 +86,93 @@ fileclose(struct file *f)
   }
 }
 
-// Get metadata about file f.
+// Get metadata about file f into user memory at st.
 int
 filestat(struct file *f, struct stat *st)
 {
+  struct stat st1;
+
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    stati(f->ip, st);
+    ilockshared(f->ip);
+    stati(f->ip, &st1);
     iunlock(f->ip);
-    return 0;
+    return copyuser(myproc()->mm, (uint)st, (char*)&st1, sizeof(st1), 1);
   }
   return -1;
 }
 
+// User memory is not touched with an inode or the log held:
+// a fault there may need the same inode, for a file mapping,
+// or find the memory gone, unmapped by another thread.
+// Bytes for files go through a kernel buffer instead,
+// copied in or out with copyuser(), as for pipes.  Kernel
+// buffers, as from filesend(), are used directly, and
+// devices copy for themselves.
+#define SMALLIO 512
+
+static char*
+iobuf(int n, char *small, int *size)
+{
+  if(n <= SMALLIO){
+    *size = SMALLIO;
+    return small;
+  }
+  *size = PGSIZE;
+  return kalloc();
+}
+
+// Read n bytes of ip at *off into addr, advancing *off, a
+// buffer at a time.  ip is locked exclusively if excl.
+// Returns the number of bytes read, or -1 if none could be.
+static int
+inoderead(struct inode *ip, char *addr, uint *off, int n, int excl)
+{
+  char small[SMALLIO], *buf;
+  int r, m, tot, size, kern;
+
+  kern = (uint)addr >= KERNBASE;
+  buf = small;
+  size = n;
+  if(!kern && (buf = iobuf(n, small, &size)) == 0)
+    return -1;
+  r = 0;
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot < size ? n - tot : size;
+    if(excl)
+      ilock(ip);
+    else
+      ilockshared(ip);
+    if((r = readi(ip, kern ? addr + tot : buf, *off, m)) > 0)
+      *off += r;
+    iunlock(ip);
+    if(r > 0 && !kern &&
+       copyuser(myproc()->mm, (uint)addr + tot, buf, r, 1) < 0)
+      r = -1;
+    if(r < m){
+      if(r > 0)
+        tot += r;
+      break;
+    }
+  }
+  if(buf != small)
+    kfree(buf);
+  if(r < 0 && tot == 0)
+    return -1;
+  return tot;
+}
+
+// Readers of an inode share its lock, which then no longer
+// protects f->off.  But if f may be in use by anyone else,
+// through another descriptor or another thread, its readers
+// must lock it exclusively.  Whoever gets a new reference
+// bumps a count before using it, so sees it above 1 and
+// waits for any reader that saw it at 1.
+static int
+offshared(struct file *f)
+{
+  return f->ref > 1 || myproc()->files->ref > 1;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -101,9 +182,16 @@ fileread(struct file *f, char *addr, int n)
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    if(f->nonblock && !(filepoll(f) & POLLIN))
+      return -1;
+    if(f->ip->type != T_DEV)
+      return inoderead(f->ip, addr, &f->off, n, offshared(f));
+    if(offshared(f))
+      ilock(f->ip);
+    else
+      ilockshared(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
@@ -112,17 +200,146 @@ fileread(struct file *f, char *addr, int n)
   panic("fileread");
 }
 
+// Which of POLLIN and POLLOUT f is ready for, and POLLHUP
+// if it is a pipe whose other end is closed.  Files and
+// devices without a poll function are always ready.
+int
+filepoll(struct file *f)
+{
+  int r;
+  struct inode *ip;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  if(f->type != FD_INODE)
+    return 0;
+  ip = f->ip;
+  r = POLLIN|POLLOUT;
+  if(ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV &&
+     devsw[ip->major].poll)
+    r = devsw[ip->major].poll(ip);
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
+
+// The pollq to join to wait for filepoll(f) to change,
+// or 0 if it never does.
+struct pollq*
+filepollq(struct file *f)
+{
+  struct inode *ip;
+
+  if(f->type == FD_PIPE)
+    return pipepollq(f->pipe);
+  if(f->type != FD_INODE)
+    return 0;
+  ip = f->ip;
+  if(ip->type == T_DEV && ip->major >= 0 && ip->major < NDEV)
+    return devsw[ip->major].pollq;
+  return 0;
+}
+
+// Read into the cnt buffers of iov in turn, starting at
+// offset off, or at f->off if off is -1.  The inode is locked
+// shared when f->off is not used.  Pipes and devices wait
+// for input, so they fill only the first buffer, and have no
+// offsets.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, tot, excl;
+  uint o, *op;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_PIPE || f->ip->type == T_DEV){
+    if(off != -1)
+      return -1;
+    for(i = 0; i < cnt; i++)
+      if(iov[i].len > 0)
+        return fileread(f, iov[i].base, iov[i].len);
+    return 0;
+  }
+  excl = off == -1 && offshared(f);
+  o = off;
+  op = off == -1 ? &f->off : &o;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if((r = inoderead(f->ip, iov[i].base, op, iov[i].len, excl)) < 0){
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < iov[i].len)
+      break;
+  }
+  return tot;
+}
+
+// Move up to n bytes from in, at its offset, to out, without
+// copying them through user space.  A pipe is filled straight
+// from the buffer cache; other files get the bytes through a
+// kernel page.  Returns the number of bytes moved, 0 at end
+// of file.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  char *buf;
+  int r, m, tot;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type != FD_INODE || in->ip->type == T_DEV)
+    return -1;
+  if(out->type == FD_PIPE){
+    // Don't wait for room for bytes past the end of the file.
+    ilockshared(in->ip);
+    if(in->off >= in->ip->size)
+      n = 0;
+    else if(n > in->ip->size - in->off)
+      n = in->ip->size - in->off;
+    iunlock(in->ip);
+    return pipewritei(out->pipe, in, offshared(in), n);
+  }
+
+  if((buf = kalloc()) == 0)
+    return -1;
+  r = 0;
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot < PGSIZE ? n - tot : PGSIZE;
+    if((r = fileread(in, buf, m)) <= 0)
+      break;
+    if(filewrite(out, buf, r) != r){
+      r = -1;
+      break;
+    }
+  }
+  kfree(buf);
+  if(r < 0 && tot == 0)
+    return -1;
+  return tot;
+}
+
 //PAGEBREAK!
+// Most bytes written to a file in one transaction; see
+// filewrite().
+#define MAXWRITE (((MAXOPBLOCKS-1-1-2) / 2) * 512)
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  char small[SMALLIO], *buf, *src;
+  int r, size, bounce;
 
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return pipewrite(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -130,16 +347,31 @@ filewrite(struct file *f, char *addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+    int max = MAXWRITE;
     int i = 0;
+    bounce = (uint)addr < KERNBASE && f->ip->type != T_DEV;
+    buf = small;
+    if(bounce){
+      if((buf = iobuf(n, small, &size)) == 0)
+        return -1;
+      if(max > size)
+        max = size;
+    }
+    r = 0;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
 
+      src = addr + i;
+      if(bounce){
+        if(copyuser(myproc()->mm, (uint)src, buf, n1, 0) < 0)
+          break;
+        src = buf;
+      }
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
+      if ((r = writei(f->ip, src, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
@@ -150,8 +382,82 @@ filewrite(struct file *f, char *addr, int n)
         panic("short filewrite");
       i += r;
     }
+    if(buf != small)
+      kfree(buf);
     return i == n ? n : -1;
   }
   panic("filewrite");
 }
 
+
+// Write the cnt buffers of iov in turn, starting at offset
+// off, or at f->off if off is -1.  As many bytes as fit in a
+// transaction are gathered from the buffers, then written
+// under one ilock().
+int
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  char *buf;
+  int i, r, n1, m, tot, done, err;
+  uint o;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_PIPE || f->ip->type == T_DEV){
+    if(off != -1)
+      return -1;
+    tot = 0;
+    for(i = 0; i < cnt; i++){
+      r = filewrite(f, iov[i].base, iov[i].len);
+      if(r > 0)
+        tot += r;
+      if(r != iov[i].len)
+        return tot > 0 ? tot : -1;
+    }
+    return tot;
+  }
+
+  if((buf = kalloc()) == 0)
+    return -1;
+  o = off;
+  tot = 0;
+  i = 0;
+  done = 0;   // bytes of iov[i] gathered
+  err = 0;
+  while(i < cnt && !err){
+    for(m = 0; i < cnt && m < MAXWRITE; m += n1){
+      n1 = iov[i].len - done;
+      if(n1 > MAXWRITE - m)
+        n1 = MAXWRITE - m;
+      if(copyuser(myproc()->mm, (uint)iov[i].base + done, buf + m, n1, 0) < 0){
+        err = 1;
+        break;
+      }
+      if((done += n1) == iov[i].len){
+        i++;
+        done = 0;
+      }
+    }
+    if(m == 0)
+      break;
+    begin_op();
+    ilock(f->ip);
+    if(off == -1)
+      o = f->off;
+    if((r = writei(f->ip, buf, o, m)) > 0){
+      o += r;
+      tot += r;
+    }
+    if(off == -1)
+      f->off = o;
+    iunlock(f->ip);
+    end_op();
+    if(r != m)
+      err = 1;
+  }
+  kfree(buf);
+  // Earlier transactions have committed; report what they wrote.
+  if(err && tot == 0)
+    return -1;
+  return tot;
+}
@@ -3,6 +3,7 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;  // O_NONBLOCK
   struct pipe *pipe;
   struct inode *ip;
   uint off;
@@ -31,11 +32,18 @@ struct inode {
   uint addrs[NDIRECT+1];
 };
 
+// Processes in poll() watching a pipe or device; see poll.c.
+struct pollq {
+  struct pollent *head;
+};
+
 // table mapping major device number to
 // device functions
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*);   // POLLIN and POLLOUT, if ready
+  struct pollq *pollq;          // woken when poll's answer changes
 };
 
 extern struct devsw devsw[];
@@ -1,11 +1,13 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// Tiny executable so that the limit can be filling the proc table,
+// which should hold thousands of processes.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 
-#define N  1000
+#define N  5000     // more than NPROC
+#define MIN 2000    // forks that must work before the table fills
 
 void
 printf(int fd, const char *s, ...)
@@ -33,6 +35,11 @@ forktest(void)
     exit();
   }
 
+  if(n < MIN){
+    printf(1, "fork failed too early\n");
+    exit();
+  }
+
   for(; n > 0; n--){
     if(wait() < 0){
       printf(1, "wait stopped early\n");
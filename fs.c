@@ -14,8 +14,8 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -135,7 +135,10 @@ bfree(int dev, uint b)
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode.  Code that only examines
+//   them (readi(), stati(), dirlookup()) may lock it with
+//   ilockshared() instead, so that readers of the same
+//   inode don't wait for each other.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -300,7 +303,7 @@ idup(struct inode *ip)
   return ip;
 }
 
-// Lock the given inode.
+// Lock the given inode for exclusive use.
 // Reads the inode from disk if necessary.
 void
 ilock(struct inode *ip)
@@ -334,11 +337,28 @@ ilock(struct inode *ip)
   }
 }
 
+// Lock the given inode shared with other readers, for
+// examining it and reading its content but not changing
+// them.  If the inode must first be read from disk, locks
+// it exclusively instead; iunlock() releases either.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  if(ip->valid == 0){
+    releasesleep(&ip->lock);
+    ilock(ip);
+  }
+}
+
 // Unlock the given inode.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if(ip == 0 || !holdingsleepany(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
   releasesleep(&ip->lock);
@@ -455,6 +475,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcachedrop(ip);
 }
 
 // Copy stat information from inode.
@@ -527,6 +548,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
+    pcacheupdate(ip, off, (char*)bp->data + off%BSIZE, m);
     brelse(bp);
   }
 
@@ -668,11 +690,14 @@ namex(char *path, int nameiparent, char *name)
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    acquire(&myproc()->files->lock);
+    ip = idup(myproc()->files->cwd);
+    release(&myproc()->files->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
       return 0;
@@ -0,0 +1,146 @@
+// Futexes: blocking on a word of user memory.
+//
+// futexwait() sleeps only if the word at a user address
+// still holds the value the caller last saw, and futexwake()
+// wakes threads sleeping on that address.  User-level locks
+// keep their state in the word, change it with atomic
+// instructions, and enter the kernel only when they have to
+// wait or have a waiter to wake (see uthread.c).
+//
+// A futex is named by its address space and user virtual
+// address, so it works between the threads of one process.
+// Waiters are kept in hash buckets; checking the word and
+// joining the bucket's queue happen under the bucket's lock,
+// which futexwake() also takes, so a wakeup that follows a
+// change to the word is never lost.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define NFUTEX 61
+
+struct fwaiter {
+  struct mm *mm;
+  uint addr;
+  int woken;
+  struct fwaiter *next;
+};
+
+struct fbucket {
+  struct spinlock lock;
+  struct fwaiter *head;   // oldest waiter first
+};
+
+static struct fbucket futex[NFUTEX];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futex[i].lock, "futex");
+}
+
+static struct fbucket*
+futexbucket(struct mm *mm, uint addr)
+{
+  return &futex[((uint)mm ^ (addr >> 2)) % NFUTEX];
+}
+
+// Read the word at user address addr through mm's page
+// table, without faulting.  Returns -1 if it is not mapped.
+static int
+futexload(struct mm *mm, uint addr, uint *v)
+{
+  char *ka;
+
+  if((ka = uva2ka(mm->pgdir, (char*)addr)) == 0)
+    return -1;
+  *v = *(uint*)(ka + (addr & (PGSIZE-1)));
+  return 0;
+}
+
+// If the word at addr holds val, sleep until futexwake()
+// on addr, or for at most n ticks if n is not 0.
+// Returns 0 if woken, -1 if the word did not hold val,
+// the time ran out or the process was killed.
+int
+futexwait(uint addr, uint val, uint n)
+{
+  struct mm *mm = myproc()->mm;
+  struct fbucket *b;
+  struct fwaiter w, **pp;
+  uint v;
+
+  if(addr % 4)
+    return -1;
+  b = futexbucket(mm, addr);
+  for(;;){
+    if(pagefault(mm, addr, 0) < 0)
+      return -1;
+    acquire(&b->lock);
+    if(futexload(mm, addr, &v) == 0)
+      break;
+    // Unmapped by another thread since; fault it in again.
+    release(&b->lock);
+  }
+  if(v != val){
+    release(&b->lock);
+    return -1;
+  }
+
+  w.mm = mm;
+  w.addr = addr;
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &b->head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  if(!myproc()->killed){
+    if(n)
+      sleeptimeout(&w, &b->lock, n);
+    else
+      sleep(&w, &b->lock);
+  }
+  if(!w.woken){
+    for(pp = &b->head; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&b->lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake at most n threads of the current process waiting
+// on addr, oldest first.  Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  struct mm *mm = myproc()->mm;
+  struct fbucket *b;
+  struct fwaiter *w, **pp;
+  int woken;
+
+  b = futexbucket(mm, addr);
+  woken = 0;
+  acquire(&b->lock);
+  pp = &b->head;
+  while(woken < n && (w = *pp) != 0){
+    if(w->mm != mm || w->addr != addr){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&b->lock);
+  return woken;
+}
@@ -0,0 +1,163 @@
+// Vectored and positional I/O benchmark.  Writes and reads a
+// file of records, each a 16-byte header and a 496-byte
+// payload, three ways: two calls per record, one readv() or
+// writev() per record, and one per 8 records.  Then 1 and 4
+// processes read the file through one shared descriptor with
+// pread(), which leaves the shared offset alone.  Reports
+// system calls and microseconds for each.
+//
+// usage: iobench [passes]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+#include "x86.h"
+
+#define HDR 16
+#define PAY 496
+#define REC (HDR+PAY)
+#define NREC 64           // 32 KB, within MAXFILE
+#define BATCH 8           // records per call, batched
+#define NPASS 20
+
+char *file = "iobench.tmp";
+char hdr[BATCH][HDR];
+char pay[BATCH][PAY];
+char rec[REC];
+struct iovec iov[2*BATCH];
+
+uint
+elapsed(uint64 start)
+{
+  uint rem;
+
+  return divl(nsec() - start, 1000, &rem);
+}
+
+void
+setiov(int nrec)
+{
+  int i;
+
+  for(i = 0; i < nrec; i++){
+    iov[2*i].base = hdr[i];
+    iov[2*i].len = HDR;
+    iov[2*i+1].base = pay[i];
+    iov[2*i+1].len = PAY;
+  }
+}
+
+// Write or read NREC records, batch at a time, with batch 0
+// meaning two plain calls per record.  Returns the calls made.
+int
+pass(int wr, int batch)
+{
+  int fd, i, calls, r;
+
+  if(wr){
+    unlink(file);
+    fd = open(file, O_CREATE|O_RDWR);
+  } else
+    fd = open(file, O_RDONLY);
+  if(fd < 0){
+    printf(1, "iobench: cannot open %s\n", file);
+    exit();
+  }
+  calls = 0;
+  setiov(batch ? batch : 1);
+  for(i = 0; i < NREC; i += batch ? batch : 1){
+    if(batch == 0){
+      if(wr)
+        r = (write(fd, hdr[0], HDR) == HDR) + (write(fd, pay[0], PAY) == PAY);
+      else
+        r = (read(fd, hdr[0], HDR) == HDR) + (read(fd, pay[0], PAY) == PAY);
+      r = r == 2 ? REC : -1;
+      calls += 2;
+    } else {
+      if(wr)
+        r = writev(fd, iov, 2*batch);
+      else
+        r = readv(fd, iov, 2*batch);
+      r = r == batch*REC ? REC : -1;
+      calls++;
+    }
+    if(r < 0){
+      printf(1, "iobench: %s failed\n", wr ? "write" : "read");
+      exit();
+    }
+  }
+  close(fd);
+  return calls;
+}
+
+void
+run(char *name, int wr, int batch, int npass)
+{
+  int i, calls;
+  uint64 start;
+
+  calls = 0;
+  start = nsec();
+  for(i = 0; i < npass; i++)
+    calls += pass(wr, batch);
+  printf(1, "%s: %d calls, %d us\n", name, calls, elapsed(start));
+}
+
+// n processes each read the whole file npass times through
+// the shared descriptor fd.
+void
+preadrun(int fd, int n, int npass)
+{
+  int i, j, off;
+  uint64 start;
+
+  start = nsec();
+  for(i = 0; i < n; i++){
+    if(fork() == 0){
+      for(j = 0; j < npass; j++)
+        for(off = 0; off < NREC*REC; off += REC)
+          if(pread(fd, rec, REC, off) != REC){
+            printf(1, "iobench: pread failed\n");
+            exit();
+          }
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  printf(1, "pread, %d procs sharing a descriptor: %d KB in %d us\n",
+         n, n * npass * (NREC*REC/1024), elapsed(start));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npass, fd;
+
+  npass = NPASS;
+  if(argc > 1)
+    npass = atoi(argv[1]);
+  if(npass < 1)
+    npass = 1;
+  memset(hdr, 'h', sizeof(hdr));
+  memset(pay, 'p', sizeof(pay));
+
+  run("write, 2 calls per record", 1, 0, npass);
+  run("writev, 1 call per record", 1, 1, npass);
+  run("writev, 1 call per 8 records", 1, BATCH, npass);
+  run("read, 2 calls per record", 0, 0, npass);
+  run("readv, 1 call per record", 0, 1, npass);
+  run("readv, 1 call per 8 records", 0, BATCH, npass);
+
+  if((fd = open(file, O_RDONLY)) < 0){
+    printf(1, "iobench: cannot open %s\n", file);
+    exit();
+  }
+  preadrun(fd, 1, npass);
+  preadrun(fd, 4, npass);
+  close(fd);
+  unlink(file);
+  exit();
+}
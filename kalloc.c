@@ -21,26 +21,123 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  ushort *ref;  // references to each allocated page, below phystop
 } kmem;
 
+uint phystop;  // top of the physical memory in use, at most PHYSTOP
+uint mbinfo;   // physical address of multiboot information, if any
+
+// One entry of a BIOS memory map.
+struct e820entry {
+  uint addrlo, addrhi;
+  uint lenlo, lenhi;
+  uint type;
+};
+#define E820_RAM 1
+#define NMEMMAP  32
+
+static struct e820entry memmap[NMEMMAP];
+static int nmemmap;
+
+// Copy the memory map left by the boot loader (see bootasm.S),
+// or by a multiboot loader, into memmap.  Both must lie in
+// the first 4MB, which is all that entrypgdir maps.
+static void
+readmemmap(void)
+{
+  struct e820entry *e;
+  uint *mbi, n;
+  char *p;
+
+  if(mbinfo != 0 && mbinfo < 4*1024*1024){
+    mbi = P2V(mbinfo);
+    if((mbi[0] & (1<<6)) == 0 || mbi[12] + mbi[11] > 4*1024*1024)
+      return;
+    // Each entry is preceded by its size.
+    for(p = P2V(mbi[12]); p < (char*)P2V(mbi[12] + mbi[11]); p += *(uint*)p + 4)
+      if(nmemmap < NMEMMAP)
+        memmap[nmemmap++] = *(struct e820entry*)(p + 4);
+    return;
+  }
+  n = *(ushort*)P2V(E820MAP);
+  e = P2V(E820MAP + 4);
+  while(nmemmap < n && nmemmap < NMEMMAP){
+    memmap[nmemmap] = e[nmemmap];
+    nmemmap++;
+  }
+}
+
+// Return the end of the RAM that starts at EXTMEM, which may
+// be made up of several adjacent map entries, or 0 if the
+// memory map does not say.
+static uint
+memtop(void)
+{
+  struct e820entry *e;
+  uint top, last, end;
+
+  top = EXTMEM;
+  do {
+    last = top;
+    for(e = memmap; e < &memmap[nmemmap]; e++){
+      if(e->type != E820_RAM || e->addrhi != 0 || e->addrlo > top)
+        continue;
+      end = e->addrlo + e->lenlo;
+      if(e->lenhi != 0 || end < e->addrlo)
+        end = 0xFFFFFFFF;  // past 4GB
+      if(end > top)
+        top = end;
+    }
+  } while(top != last);
+  return top == EXTMEM ? 0 : top;
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// kinit1() also sets phystop from the memory map and puts the
+// page reference counts at vstart.
 void
 kinit1(void *vstart, void *vend)
 {
+  uint n;
+
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
-  freerange(vstart, vend);
+
+  readmemmap();
+  if((phystop = memtop()) == 0)
+    phystop = 0xE000000;  // no memory map; assume 224MB
+  if(phystop > PHYSTOP)
+    phystop = PHYSTOP;
+  phystop = PGROUNDDOWN(phystop);
+  if(phystop < V2P(vend))
+    panic("kinit1: not enough memory");
+
+  n = phystop/PGSIZE * sizeof(kmem.ref[0]);
+  if((char*)vstart + n > (char*)vend)
+    panic("kinit1: too much memory");
+  kmem.ref = vstart;
+  memset(kmem.ref, 0, n);
+  freerange((char*)vstart + n, vend);
 }
 
 void
 kinit2(void *vstart, void *vend)
 {
+  struct e820entry *e;
+  uint mb;
+
   freerange(vstart, vend);
   kmem.use_lock = 1;
+
+  mb = 0;
+  for(e = memmap; e < &memmap[nmemmap]; e++)
+    if(e->type == E820_RAM)
+      mb += (e->lenhi << 12) + (e->lenlo >> 20);
+  cprintf("mem: %d MB of RAM, using %d MB\n", mb, phystop >> 20);
 }
 
 void
@@ -52,18 +149,33 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc().  The page is freed when its last
+// reference goes away.  (The exception is when
 // initializing the allocator; see kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  ushort *ref;
 
-  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
     panic("kfree");
 
+  ref = &kmem.ref[V2P(v)/PGSIZE];
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(*ref > 1){
+    (*ref)--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  *ref = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -87,10 +199,38 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to a page returned by kalloc(),
+// so that it can be shared.  Each reference is
+// dropped with kfree().
+void
+kdup(char *v)
+{
+  ushort *ref;
+
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
+    panic("kdup");
+
+  ref = &kmem.ref[V2P(v)/PGSIZE];
+  acquire(&kmem.lock);
+  if(*ref < 1 || *ref == 0xFFFF)
+    panic("kdup ref");
+  (*ref)++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to a page returned by kalloc().
+int
+krefcnt(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
+
@@ -0,0 +1,15 @@
+// Read-only pages the kernel maps into every address space,
+// so user code can read them without a system call.
+
+// At UINFO, one per address space.
+struct uinfo {
+  int pid;          // 0 if threads with other pids share the space
+  int uid;
+  int gid;
+};
+
+// At KINFO, one page shared by all address spaces.
+struct kinfo {
+  volatile uint ticks;        // same as uptime()
+  uint tsckhz;                // TSC cycles per millisecond
+};
@@ -43,6 +43,15 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+// The timer is taken to count at 1 GHz, as QEMU's does, so
+// that TICR below makes 100 ticks a second.  The TSC is
+// timed against it once, at boot.
+#define TIMERKHZ 1000000
+#define CALCOUNT 10000000   // timer counts to time the TSC over
+
+uint tsckhz;            // TSC cycles per millisecond
+static uint64 tscbase;  // TSC when nanotime() was 0
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -51,6 +60,27 @@ lapicw(int index, int value)
   lapic[ID];  // wait for write to finish, by reading
 }
 
+// Count the TSC cycles while the timer counts CALCOUNT
+// down, one-shot and masked.
+static void
+tsccalibrate(void)
+{
+  uint64 t0, t1;
+  uint rem;
+
+  lapicw(TDCR, X1);
+  lapicw(TIMER, MASKED);
+  lapicw(TICR, 0xFFFFFFFF);
+  t0 = rdtsc64();
+  while(lapic[TCCR] > 0xFFFFFFFF - CALCOUNT)
+    ;
+  t1 = rdtsc64();
+  tsckhz = divl((t1 - t0) * (TIMERKHZ / 1000), CALCOUNT / 1000, &rem);
+  if(tsckhz == 0)
+    tsckhz = 1;
+  tscbase = t1;
+}
+
 void
 lapicinit(void)
 {
@@ -60,6 +90,10 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
+  // The boot CPU gets here first.
+  if(tsckhz == 0)
+    tsccalibrate();
+
   // The timer repeatedly counts down at bus frequency
   // from lapic[TICR] and then issues an interrupt.
   // If xv6 cared more about precise timekeeping,
@@ -97,6 +131,31 @@ lapicinit(void)
   lapicw(TPR, 0);
 }
 
+// Nanoseconds since boot, from the TSC.  The CPUs' TSCs
+// are taken to run in step, as they do on QEMU and on
+// processors with an invariant TSC.
+uint64
+nanotime(void)
+{
+  uint64 t, ms;
+  uint hi, lo, rem, ns;
+
+  if(tsckhz == 0)
+    return 0;
+  t = rdtsc64();
+  if(t < tscbase)  // another CPU's TSC, slightly behind
+    return 0;
+  t -= tscbase;
+  // divl() traps if the quotient overflows 32 bits, as
+  // t / tsckhz does after about 49 days at 1 GHz: divide
+  // the high word first, then the remainder and low word.
+  hi = divl(t >> 32, tsckhz, &rem);
+  lo = divl(((uint64)rem << 32) | (uint)t, tsckhz, &rem);
+  ms = ((uint64)hi << 32) | lo;
+  ns = divl((uint64)rem * 1000000, tsckhz, &rem);
+  return ms * 1000000 + ns;
+}
+
 int
 lapicid(void)
 {
@@ -113,6 +172,17 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+// Must be called with interrupts disabled.
+void
+lapicipi(int apicid, int vector)
+{
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,146 @@
+// Scheduling latency benchmark: an interactive process that
+// sleeps, then wakes a server process over a pipe and waits
+// for its answer, while CPU-bound processes compete for the
+// CPUs.  Reports the distribution of the round-trip times,
+// which is dominated by how long the woken server waits for
+// a CPU, and the scheduler's accounting for each process.
+//
+// usage: latbench [nhogs [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+#define NHOG    4
+#define NROUND  200
+#define MAXHOG  32
+#define MAXROUND 1000
+
+uint lat[MAXROUND];
+struct pstat ps[NPROC];
+
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
+void
+hog(void)
+{
+  volatile uint x;
+
+  for(x = 0;; x++)
+    ;
+}
+
+void
+server(int in, int out)
+{
+  char c;
+
+  while(read(in, &c, 1) == 1)
+    write(out, &c, 1);
+  exit();
+}
+
+void
+sort(uint *a, int n)
+{
+  int i, j;
+  uint t;
+
+  for(i = 1; i < n; i++){
+    t = a[i];
+    for(j = i; j > 0 && a[j-1] > t; j--)
+      a[j] = a[j-1];
+    a[j] = t;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nhog, nround, i, n, spid;
+  int hogs[MAXHOG], ping[2], pong[2];
+  uint t0;
+  char c;
+
+  nhog = NHOG;
+  nround = NROUND;
+  if(argc > 1)
+    nhog = atoi(argv[1]);
+  if(argc > 2)
+    nround = atoi(argv[2]);
+  if(nhog < 0 || nhog > MAXHOG)
+    nhog = NHOG;
+  if(nround < 1 || nround > MAXROUND)
+    nround = NROUND;
+
+  for(i = 0; i < nhog; i++){
+    if((hogs[i] = fork()) < 0){
+      printf(1, "latbench: fork failed\n");
+      exit();
+    }
+    if(hogs[i] == 0)
+      hog();
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "latbench: pipe failed\n");
+    exit();
+  }
+  if((spid = fork()) < 0){
+    printf(1, "latbench: fork failed\n");
+    exit();
+  }
+  if(spid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    server(ping[0], pong[1]);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  // Let the hogs use up their top-level time slices.
+  sleep(10);
+  for(i = 0; i < nround; i++){
+    sleep(1);
+    t0 = rdtsc();
+    if(write(ping[1], "x", 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf(1, "latbench: pipe broke\n");
+      break;
+    }
+    lat[i] = rdtsc() - t0;
+  }
+  nround = i;
+
+  // Everything in the table is ours or idle, apart from
+  // init and the shell.
+  n = getpinfo(ps, NPROC);
+  printf(1, "pid  name  prio  nice  run  wait\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%d  %s%s  %d  %d  %d  %d\n", ps[i].pid, ps[i].name,
+           ps[i].pid == spid ? " (server)" : "", ps[i].prio, ps[i].nice,
+           ps[i].rtime, ps[i].wtime);
+
+  close(ping[1]);
+  close(pong[0]);
+  for(i = 0; i < nhog; i++)
+    kill(hogs[i]);
+  for(i = 0; i < nhog + 1; i++)
+    wait();
+
+  if(nround == 0)
+    exit();
+  sort(lat, nround);
+  printf(1, "%d hogs, %d rounds, round trip in cycles:\n", nhog, nround);
+  printf(1, "p50 %d  p90 %d  p99 %d  max %d\n", lat[nround/2],
+         lat[nround*9/10], lat[nround*99/100], lat[nround-1]);
+  exit();
+}
@@ -0,0 +1,122 @@
+// Lock contention benchmark: 1, 2, 4 and 8 processes at once
+// hammer one kernel lock each round, and the total throughput
+// is reported in operations per tick.  Run it with different
+// numbers of CPUs (make qemu CPUS=n) to see how the locks scale.
+//
+//   bcache: read() a cached file, through bget()'s bcache.lock
+//   ptable: kill() a pid that does not exist, under ptable.lock
+//   kmem:   sbrk() a page up and down, through kmem.lock
+//
+// usage: lockbench [ops-per-process]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NOPS 2000
+#define MAXPROC 8
+
+char buf[512];
+
+void
+bcacheop(void)
+{
+  static int fd = -1;
+
+  if(fd < 0 || read(fd, buf, sizeof(buf)) <= 0){
+    if(fd >= 0)
+      close(fd);
+    if((fd = open("README", O_RDONLY)) < 0){
+      printf(1, "lockbench: cannot open README\n");
+      exit();
+    }
+  }
+}
+
+void
+ptableop(void)
+{
+  kill(0x7fffffff);
+}
+
+void
+kmemop(void)
+{
+  char *p;
+
+  p = sbrk(4096);
+  if(p == (char*)-1){
+    printf(1, "lockbench: sbrk failed\n");
+    exit();
+  }
+  p[0] = 1;
+  sbrk(-4096);
+}
+
+struct bench {
+  char *name;
+  void (*op)(void);
+} benches[] = {
+  { "bcache", bcacheop },
+  { "ptable", ptableop },
+  { "kmem",   kmemop },
+};
+
+// Run n processes doing nops operations each, started
+// together through a pipe.  Returns the ticks taken.
+int
+run(struct bench *b, int n, int nops)
+{
+  int go[2], i, j, pid;
+  uint start;
+  char c;
+
+  if(pipe(go) < 0){
+    printf(1, "lockbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "lockbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(go[1]);
+      read(go[0], &c, 1);
+      for(j = 0; j < nops; j++)
+        b->op();
+      exit();
+    }
+  }
+  close(go[0]);
+  start = uptime();
+  close(go[1]);   // read() returns 0 in every child at once
+  for(i = 0; i < n; i++)
+    wait();
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bench *b;
+  int n, t, nops;
+
+  nops = NOPS;
+  if(argc > 1)
+    nops = atoi(argv[1]);
+  if(nops < 1)
+    nops = 1;
+  for(b = benches; b < benches + sizeof(benches)/sizeof(benches[0]); b++){
+    for(n = 1; n <= MAXPROC; n *= 2){
+      t = run(b, n, nops);
+      if(t < 1)
+        t = 1;
+      printf(1, "%s: %d procs, %d ops in %d ticks, %d ops/tick\n",
+             b->name, n, n*nops, t, n*nops/t);
+    }
+  }
+  exit();
+}
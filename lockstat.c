@@ -0,0 +1,84 @@
+// Print lock contention statistics, most waited-for locks first.
+//
+// usage: lockstat            print the counts so far
+//        lockstat -r         reset the counts
+//        lockstat cmd [arg...]
+//                            reset, run cmd, and print the counts
+//                            it caused
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NCLASS 48
+
+struct lockstat ls[NCLASS];
+
+void
+report(void)
+{
+  struct lockstat t;
+  int n, i, j;
+
+  if((n = lockstat(ls, NCLASS, 0)) < 0){
+    printf(2, "lockstat: failed\n");
+    exit();
+  }
+  // Sort by time spent waiting, then by contended acquisitions.
+  for(i = 1; i < n; i++){
+    t = ls[i];
+    for(j = i; j > 0 && (ls[j-1].waitkc < t.waitkc ||
+        (ls[j-1].waitkc == t.waitkc && ls[j-1].contended < t.contended)); j--)
+      ls[j] = ls[j-1];
+    ls[j] = t;
+  }
+  printf(1, "name  type  acquires  contended  wait(kcycles)  max-hold(cycles)\n");
+  for(i = 0; i < n; i++){
+    if(ls[i].acquires == 0)
+      continue;
+    printf(1, "%s  %s  %d  %d  %d  %d\n", ls[i].name,
+           ls[i].sleep ? "sleep" : "spin", ls[i].acquires,
+           ls[i].contended, ls[i].waitkc, ls[i].maxhold);
+  }
+}
+
+void
+reset(void)
+{
+  if(lockstat(0, 0, 1) < 0){
+    printf(2, "lockstat: reset failed (not root?)\n");
+    exit();
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, w;
+
+  if(argc < 2){
+    report();
+    exit();
+  }
+  if(strcmp(argv[1], "-r") == 0){
+    reset();
+    exit();
+  }
+
+  reset();
+  pid = fork();
+  if(pid < 0){
+    printf(2, "lockstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  while((w = wait()) >= 0 && w != pid)
+    ;
+  report();
+  exit();
+}
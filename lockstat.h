@@ -0,0 +1,10 @@
+// Lock contention statistics for all locks of one name,
+// see lockstat().  Times are TSC cycles.
+struct lockstat {
+  char name[16];
+  int sleep;        // sleep locks, not spinlocks
+  uint acquires;
+  uint contended;   // acquisitions that had to wait
+  uint waitkc;      // total time spent waiting, in units of 1024 cycles
+  uint maxhold;     // longest time held
+};
@@ -134,6 +134,10 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      // waiters are woken one at a time; let the next
+      // one in too if it would fit.
+      if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS <= LOGSIZE)
+        wakeupone(&log);
       release(&log.lock);
       break;
     }
@@ -158,7 +162,7 @@ end_op(void)
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
-    wakeup(&log);
+    wakeupone(&log);
   }
   release(&log.lock);
 
@@ -168,7 +172,7 @@ end_op(void)
     commit();
     acquire(&log.lock);
     log.committing = 0;
-    wakeup(&log);
+    wakeupone(&log);
     release(&log.lock);
   }
 }
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "namecache.h"
@@ -28,8 +29,13 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  shareinit();     // fair-share accounting
   tvinit();        // trap vectors
+  timerinit();     // kernel timers
+  futexinit();     // user-level blocking
+  pollinit();      // waiting on many descriptors
   binit();         // buffer cache
+  pcacheinit();    // file page cache
   
   users_init(); 
 
@@ -37,7 +43,7 @@ main(void)
   ideinit();       // disk 
   namecache_init();// namecache 
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(phystop)); // must come after startothers()
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
@@ -58,6 +64,7 @@ mpmain(void)
 {
   cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
   idtinit();       // load idt register
+  sysenterinit();  // fast system calls
   xchg(&(mycpu()->started), 1); // tell startothers() we're up
   scheduler();     // start running processes
 }
@@ -0,0 +1,122 @@
+// Memory pressure benchmark.  Several processes each
+// allocate a large heap and sweep over it a few times,
+// together needing more memory than the machine has, so
+// pages must be swapped out and back in.  Each page holds
+// its owner's pid and index, checked on every sweep.
+// A few more processes fill their memory and then block on
+// a pipe while the others run, so pages held by sleeping
+// processes must be paged out too; they check theirs once
+// woken.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define NCHILD 8
+#define MB     80     // per child; NCHILD*MB exceeds qemu's -m 512
+#define NSLEEP 2
+#define PASSES 3
+
+char*
+fill(int pid, int npages)
+{
+  char *mem;
+  int i;
+
+  if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+    printf(1, "memstress: pid %d: sbrk failed\n", pid);
+    exit();
+  }
+  for(i = 0; i < npages; i++){
+    ((int*)(mem + i*PGSIZE))[0] = pid;
+    ((int*)(mem + i*PGSIZE))[1] = i;
+  }
+  return mem;
+}
+
+void
+check(char *mem, int pid, int npages)
+{
+  int i;
+
+  for(i = 0; i < npages; i++){
+    if(((int*)(mem + i*PGSIZE))[0] != pid ||
+       ((int*)(mem + i*PGSIZE))[1] != i){
+      printf(1, "memstress: pid %d: page %d corrupted\n", pid, i);
+      exit();
+    }
+  }
+}
+
+void
+child(int mb)
+{
+  char *mem;
+  int npages, pass, pid;
+
+  pid = getpid();
+  npages = mb * (1024*1024/PGSIZE);
+  mem = fill(pid, npages);
+  for(pass = 0; pass < PASSES; pass++)
+    check(mem, pid, npages);
+  exit();
+}
+
+// Fill memory, then sleep in read() until the
+// parent closes the pipe.
+void
+sleeper(int mb, int fd)
+{
+  char *mem, c;
+  int npages, pid;
+
+  pid = getpid();
+  npages = mb * (1024*1024/PGSIZE);
+  mem = fill(pid, npages);
+  if(read(fd, &c, 1) != 0)
+    printf(1, "memstress: pid %d: read from idle pipe\n", pid);
+  check(mem, pid, npages);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, mb, fds[2];
+  uint start, end;
+
+  n = NCHILD;
+  mb = MB;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    mb = atoi(argv[2]);
+
+  printf(1, "memstress: %d+%d processes x %d MB, %d passes\n",
+    n, NSLEEP, mb, PASSES);
+  start = uptime();
+  if(pipe(fds) < 0){
+    printf(1, "memstress: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < NSLEEP; i++){
+    if(fork() == 0){
+      close(fds[1]);
+      sleeper(mb, fds[0]);
+    }
+  }
+  close(fds[0]);
+  for(i = 0; i < n; i++){
+    if(fork() == 0)
+      child(mb);
+  }
+  for(i = 0; i < n; i++)
+    wait();
+  close(fds[1]);
+  for(i = 0; i < NSLEEP; i++)
+    wait();
+  end = uptime();
+  printf(1, "memstress: %d ticks\n", end - start);
+  exit();
+}
@@ -0,0 +1,138 @@
+// Tests for mmap() and munmap().
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define PGSIZE 4096
+
+char buf[PGSIZE];
+
+void
+fail(char *msg)
+{
+  printf(1, "mmaptest: %s FAILED\n", msg);
+  exit();
+}
+
+// Anonymous private memory: zero-filled, writable, and
+// gone after munmap(), including from the middle.
+void
+anontest(void)
+{
+  char *p;
+  int i;
+
+  p = mmap(0, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+    fail("anon mmap");
+  for(i = 0; i < 4*PGSIZE; i++)
+    if(p[i] != 0)
+      fail("anon zero fill");
+  for(i = 0; i < 4*PGSIZE; i++)
+    p[i] = i;
+  if(munmap(p + PGSIZE, PGSIZE) < 0)
+    fail("anon munmap middle");
+  for(i = 2*PGSIZE; i < 4*PGSIZE; i++)
+    if(p[i] != (char)i)
+      fail("anon content after split");
+  if(fork() == 0){
+    p[PGSIZE] = 1;
+    exit();  // should have been killed
+  }
+  wait();
+  if(munmap(p, 4*PGSIZE) < 0)
+    fail("anon munmap");
+  printf(1, "anon ok\n");
+}
+
+// A private file mapping reads the same bytes as read().
+void
+privatetest(void)
+{
+  char *p;
+  int fd, n, i;
+
+  if((fd = open("README", O_RDONLY)) < 0)
+    fail("open README");
+  n = read(fd, buf, sizeof(buf));
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+    fail("file mmap");
+  for(i = 0; i < n; i++)
+    if(p[i] != buf[i])
+      fail("file content");
+  p[0] = 'X';  // a private copy; README is unchanged
+  if((fd = open("README", O_RDONLY)) < 0 || read(fd, buf, 1) != 1)
+    fail("reopen README");
+  close(fd);
+  if(buf[0] == 'X')
+    fail("private write reached file");
+  munmap(p, PGSIZE);
+  printf(1, "private ok\n");
+}
+
+// Writes to a shared file mapping reach the file, and
+// shared memory is shared with fork children.
+void
+sharedtest(void)
+{
+  char *p;
+  int fd, i;
+
+  unlink("mmaptest.tmp");
+  if((fd = open("mmaptest.tmp", O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  memset(buf, 'a', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+    fail("write");
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    fail("shared mmap");
+  if(fork() == 0){
+    for(i = 0; i < PGSIZE; i++)
+      p[i] = 'b';
+    exit();
+  }
+  wait();
+  if(p[PGSIZE-1] != 'b')
+    fail("shared with child");
+  if(munmap(p, PGSIZE) < 0)
+    fail("shared munmap");
+  close(fd);
+  if((fd = open("mmaptest.tmp", O_RDONLY)) < 0)
+    fail("reopen");
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+    fail("read back");
+  close(fd);
+  for(i = 0; i < PGSIZE; i++)
+    if(buf[i] != 'b')
+      fail("written back");
+  unlink("mmaptest.tmp");
+
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED)
+    fail("shared anon mmap");
+  if(fork() == 0){
+    p[0] = 'c';
+    exit();
+  }
+  wait();
+  if(p[0] != 'c')
+    fail("shared anon");
+  munmap(p, PGSIZE);
+  printf(1, "shared ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  anontest();
+  privatetest();
+  sharedtest();
+  printf(1, "mmaptest: all tests passed\n");
+  exit();
+}
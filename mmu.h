@@ -10,6 +10,12 @@
 #define CR0_PG          0x80000000      // Paging
 
 #define CR4_PSE         0x00000010      // Page size extension
+#define CR4_PGE         0x00000080      // Page global enable
+
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS  0x174          // Kernel code segment
+#define MSR_SYSENTER_ESP 0x175          // Kernel stack pointer
+#define MSR_SYSENTER_EIP 0x176          // Kernel entry point
 
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
@@ -83,6 +89,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define SPGSIZE         (PGSIZE*NPTENTRIES) // bytes mapped by a 4Mbyte page
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
@@ -94,12 +101,21 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_G           0x100   // Global: not flushed by lcr3
+#define PTE_SWAP        0x200   // Paged out; address holds swap slot (software)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
+// Page fault error code flags
+#define FEC_PR          0x1     // Page fault caused by protection violation
+#define FEC_WR          0x2     // Page fault caused by a write
+#define FEC_U           0x4     // Page fault occured while in user mode
+
 #ifndef __ASSEMBLER__
 typedef uint pte_t;
 
@@ -13,7 +13,7 @@ void test_simple_open() {
   printf(1, "\n=== TEST 1: Simple File Open ===\n");
   printf(1, "Opening /README %d times\n\n", ITERATIONS);
   
-  uint start = uptime();
+  uint64 start = nsec();
   
   for(int i = 0; i < ITERATIONS; i++) {
     int fd = open("README", 0);
@@ -24,12 +24,10 @@ void test_simple_open() {
     close(fd);
   }
   
-  uint end = uptime();
+  uint ns = nsec() - start;
   
-  printf(1, "Total time: %d ticks\n", end - start);
-  printf(1, "Time per open: %d.%d ticks\n", 
-         (end - start) / ITERATIONS,
-         ((end - start) * 10 / ITERATIONS) % 10);
+  printf(1, "Total time: %d us\n", ns / 1000);
+  printf(1, "Time per open: %d ns\n", ns / ITERATIONS);
   printf(1, "\nWithout cache: each open = 2 disk reads\n");
   printf(1, "  (1 for root dir, 1 for README entry)\n");
   printf(1, "Total disk reads WITHOUT cache: %d\n", ITERATIONS * 2);
@@ -56,7 +54,7 @@ void test_nested_path() {
   
   printf(1, "Opening /a/b/c/file.txt %d times\n\n", ITERATIONS);
   
-  uint start = uptime();
+  uint64 start = nsec();
   
   for(int i = 0; i < ITERATIONS; i++) {
     fd = open("a/b/c/file.txt", 0);
@@ -67,12 +65,10 @@ void test_nested_path() {
     close(fd);
   }
   
-  uint end = uptime();
+  uint ns = nsec() - start;
   
-  printf(1, "Total time: %d ticks\n", end - start);
-  printf(1, "Time per open: %d.%d ticks\n", 
-         (end - start) / ITERATIONS,
-         ((end - start) * 10 / ITERATIONS) % 10);
+  printf(1, "Total time: %d us\n", ns / 1000);
+  printf(1, "Time per open: %d ns\n", ns / ITERATIONS);
   
   printf(1, "\nPath components: / -> a -> b -> c -> file.txt\n");
   printf(1, "Without cache: each open = 5 disk reads\n");
@@ -116,7 +112,7 @@ void test_multiple_files() {
   
   printf(1, "Opening each file 20 times (200 total opens)\n\n");
   
-  uint start = uptime();
+  uint64 start = nsec();
   
   for(int round = 0; round < 20; round++) {
     for(int i = 0; i < 10; i++) {
@@ -138,12 +134,10 @@ void test_multiple_files() {
     }
   }
   
-  uint end = uptime();
+  uint ns = nsec() - start;
   
-  printf(1, "Total time: %d ticks\n", end - start);
-  printf(1, "Time per open: %d.%d ticks\n", 
-         (end - start) / 200,
-         ((end - start) * 10 / 200) % 10);
+  printf(1, "Total time: %d us\n", ns / 1000);
+  printf(1, "Time per open: %d ns\n", ns / 200);
   
   printf(1, "\nWithout cache: 200 opens × 3 disk reads = 600 reads\n");
   printf(1, "  (root + testdir + file for each open)\n");
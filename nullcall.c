@@ -0,0 +1,57 @@
+// Null system call benchmark: cycles per getpid(), entering
+// the kernel by sysenter (the usys.S stubs) and by the older
+// int $T_SYSCALL, which the kernel still accepts, against
+// ulib's getpid(), which reads the uinfo page.
+//
+// usage: nullcall [calls]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "traps.h"
+#include "syscall.h"
+
+#define N 100000
+
+static inline int
+getpid_int(void)
+{
+  int r;
+
+  asm volatile("int %1" : "=a" (r) : "i" (T_SYSCALL), "0" (SYS_getpid) :
+               "memory");
+  return r;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, pid;
+  uint t0, t1, t2, t3;
+
+  n = N;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1)
+    n = 1;
+  pid = sysgetpid();
+  if(getpid_int() != pid || getpid() != pid){
+    printf(1, "nullcall: int, sysenter and uinfo disagree\n");
+    exit();
+  }
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid_int();
+  t1 = rdtsc();
+  for(i = 0; i < n; i++)
+    sysgetpid();
+  t2 = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid();
+  t3 = rdtsc();
+  printf(1, "getpid: int $T_SYSCALL %d cycles, sysenter %d cycles, "
+         "uinfo page %d cycles\n", (t1 - t0) / n, (t2 - t1) / n, (t3 - t2) / n);
+  exit();
+}
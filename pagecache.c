@@ -0,0 +1,233 @@
+// Page cache.
+//
+// The page cache holds page-sized pieces of file content,
+// keyed by (dev, inum, off), so that every process running
+// the same binary maps the same physical pages for the parts
+// of it that it never writes.
+//
+// A cached page holds one kalloc() reference of its own and
+// every page table that maps it holds another (see kdup()).
+// An entry is only recycled once no page table maps it: a
+// process writing a MAP_SHARED region changes nothing but
+// the mapped page, so anyone else mapping that part of the
+// file must be given the same page, not a stale copy read
+// from disk.
+//
+// Pages are filled from the buffer cache with readi() and
+// kept coherent by writei(), which patches any cached copy
+// of the bytes it writes.
+//
+// Interface:
+// * pcacheget() returns a referenced page of file content.
+// * pcacheupdate() copies freshly written file bytes into the cache.
+// * pcachedrop() forgets every page of a file being truncated.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 61
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;               // file offset of first byte
+  char *data;             // cached content, 0 if entry is unused
+  struct pcpage *hnext;   // hash chain
+  struct pcpage *prev;    // LRU list
+  struct pcpage *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+
+  // All pages of one file hash to the same chain,
+  // so that pcacheupdate() and pcachedrop() look at one chain.
+  struct pcpage *hash[NPCHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct pcpage head;
+} pcache;
+
+static struct pcpage**
+pchash(uint dev, uint inum)
+{
+  return &pcache.hash[(dev * 31 + inum) % NPCHASH];
+}
+
+void
+pcacheinit(void)
+{
+  struct pcpage *pg;
+
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPCACHE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+// Look for a cached page.  Caller must hold pcache.lock.
+static struct pcpage*
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *pg;
+
+  for(pg = *pchash(dev, inum); pg; pg = pg->hnext)
+    if(pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  return 0;
+}
+
+// Remove pg from its hash chain and drop the cache's
+// reference to its page.  Caller must hold pcache.lock.
+static void
+pcevict(struct pcpage *pg)
+{
+  struct pcpage **pp;
+
+  for(pp = pchash(pg->dev, pg->inum); *pp; pp = &(*pp)->hnext){
+    if(*pp == pg){
+      *pp = pg->hnext;
+      break;
+    }
+  }
+  kfree(pg->data);
+  pg->data = 0;
+  pg->hnext = 0;
+}
+
+// Move pg to the most recently used end of the list.
+// Caller must hold pcache.lock.
+static void
+pctouch(struct pcpage *pg)
+{
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+}
+
+// Return the page of ip's content starting at byte off,
+// reading it in if it is not cached.  Bytes past the end
+// of the file read as zeros.  The caller gets its own
+// reference to the page, to be dropped with kfree(), and
+// must not write to it unless shared is set.  If every
+// entry is mapped, a private caller gets a page of its own,
+// outside the cache, and a shared one gets 0, as it does if
+// out of memory.  Caller must hold ip->lock.
+char*
+pcacheget(struct inode *ip, uint off, int shared)
+{
+  struct pcpage *pg, **hp;
+  char *mem;
+  int n;
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    pctouch(pg);
+    kdup(pg->data);
+    release(&pcache.lock);
+    return pg->data;
+  }
+  release(&pcache.lock);
+
+  // Not cached; read it without holding pcache.lock,
+  // since readi() sleeps.
+  if((mem = kallocswap()) == 0)
+    return 0;
+  if((n = readi(ip, mem, off, PGSIZE)) < 0){
+    kfree(mem);
+    return 0;
+  }
+  if(n < PGSIZE)
+    memset(mem + n, 0, PGSIZE - n);
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    // Someone else cached it while we were reading.
+    pctouch(pg);
+    kdup(pg->data);
+    release(&pcache.lock);
+    kfree(mem);
+    return pg->data;
+  }
+
+  // Recycle the least recently used entry that is not
+  // mapped anywhere.
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+    if(pg->data == 0 || krefcnt(pg->data) == 1)
+      break;
+  if(pg == &pcache.head){
+    release(&pcache.lock);
+    if(shared){
+      kfree(mem);
+      return 0;
+    }
+    return mem;
+  }
+  if(pg->data)
+    pcevict(pg);
+  pg->dev = ip->dev;
+  pg->inum = ip->inum;
+  pg->off = off;
+  pg->data = mem;
+  hp = pchash(ip->dev, ip->inum);
+  pg->hnext = *hp;
+  *hp = pg;
+  pctouch(pg);
+  kdup(mem);
+  release(&pcache.lock);
+  return mem;
+}
+
+// Copy n bytes just written at offset off of ip into any
+// cached pages that hold those bytes.  src must be kernel memory.
+// Caller must hold ip->lock.
+void
+pcacheupdate(struct inode *ip, uint off, char *src, uint n)
+{
+  struct pcpage *pg;
+  uint lo, hi;
+
+  acquire(&pcache.lock);
+  for(pg = *pchash(ip->dev, ip->inum); pg; pg = pg->hnext){
+    if(pg->dev != ip->dev || pg->inum != ip->inum)
+      continue;
+    if(pg->off >= off + n || pg->off + PGSIZE <= off)
+      continue;
+    lo = pg->off > off ? pg->off : off;
+    hi = pg->off + PGSIZE < off + n ? pg->off + PGSIZE : off + n;
+    memmove(pg->data + (lo - pg->off), src + (lo - off), hi - lo);
+  }
+  release(&pcache.lock);
+}
+
+// Forget all cached pages of ip, whose content is going away.
+// Pages still mapped by processes stay valid for them.
+void
+pcachedrop(struct inode *ip)
+{
+  struct pcpage *pg, *next;
+
+  acquire(&pcache.lock);
+  for(pg = *pchash(ip->dev, ip->inum); pg; pg = next){
+    next = pg->hnext;
+    if(pg->dev == ip->dev && pg->inum == ip->inum)
+      pcevict(pg);
+  }
+  release(&pcache.lock);
+}
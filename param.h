@@ -1,6 +1,10 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         4  // scheduler priority levels
+#define NICEMAX      19  // largest nice value
+#define NSHARE       16  // uids with a CPU share of their own
+#define NLOCKCLASS   48  // lock names with statistics of their own
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -11,4 +15,9 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define NVMA         16  // lazily mapped regions per process
+#define NPCACHE     256  // pages in the file page cache
+#define SWAPDEV       0  // disk holding the swap area (the boot disk)
+#define SWAPSTART  2048  // first swap block, past the kernel image
+#define NSWAPBLOCKS 65536  // size of swap area in blocks
 
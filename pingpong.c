@@ -0,0 +1,67 @@
+// Pipe ping-pong: a parent and child pass one byte back and
+// forth over two pipes, so each round trip is two wakeups
+// and, on one CPU, two context switches.  Reports the
+// average and fastest round trip in TSC cycles.
+//
+// usage: pingpong [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define NROUND 10000
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2], n, i, pid;
+  uint t0, t1, total, min;
+  char c;
+
+  n = NROUND;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1)
+    n = 1;
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf(1, "pingpong: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pingpong: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit();
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  total = 0;
+  min = ~0;
+  c = 'x';
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1){
+      printf(1, "pingpong: read failed\n");
+      break;
+    }
+    t1 = rdtsc() - t0;
+    total += t1;
+    if(t1 < min)
+      min = t1;
+  }
+  close(ping[1]);
+  close(pong[0]);
+  wait();
+  printf(1, "pingpong: %d round trips, avg %d cycles, min %d cycles\n",
+         i, total / (i ? i : 1), min);
+  exit();
+}
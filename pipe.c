@@ -2,27 +2,48 @@
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// The ring buffer is PIPEPAGES whole pages, copied a
+// contiguous span at a time.
+#define PIPEPAGES 4
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+#define PIPEWAKE PGSIZE
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // readers asleep on nread
+  int wwait;      // writers asleep on nwrite
+  int wbusy;      // pipewritei() is filling the ring unlocked
+  struct pollq pollq;
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->data[i])
+      kfree(p->data[i]);
+  kfree((char*)p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -30,6 +51,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->data[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +73,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -67,55 +92,254 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  pollwake(&p->pollq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
-//PAGEBREAK: 40
+// Bytes from ring offset off to the end of its page,
+// at most n.
+static uint
+span(uint off, uint n)
+{
+  uint m;
+
+  m = PGSIZE - off % PGSIZE;
+  return m < n ? m : n;
+}
+
+// Readers and writers are woken one at a time, and one that
+// leaves, for whatever reason, passes the turn on if there
+// is still something for the next.  A blocked writer is woken
+// only once PIPEWAKE bytes are free.
+static void
+passturn(struct pipe *p)
+{
+  if(p->rwait && p->nread != p->nwrite)
+    wakeupone(&p->nread);
+  if(p->wwait && !p->wbusy && p->nwrite + PIPEWAKE <= p->nread + PIPESIZE)
+    wakeupone(&p->nwrite);
+}
+
+// Which of POLLIN and POLLOUT the reading or writing end
+// is ready for, and POLLHUP if the other end is closed.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipepoll(struct pipe *p, int writable)
+{
+  int r;
+
+  r = 0;
+  acquire(&p->lock);
+  if(writable){
+    if(p->readopen == 0)
+      r = POLLOUT|POLLHUP;  // write fails at once
+    else if(!p->wbusy && p->nwrite != p->nread + PIPESIZE)
+      r = POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      r = POLLIN;
+    if(p->writeopen == 0)
+      r = POLLIN|POLLHUP;   // read returns 0 at once
+  }
+  release(&p->lock);
+  return r;
+}
+
+struct pollq*
+pipepollq(struct pipe *p)
+{
+  return &p->pollq;
+}
+
+// Bounce buffers.  User memory is never touched under
+// p->lock: another thread could unmap it, and a fault with a
+// spinlock held cannot be handled.  Bytes go through a buffer
+// in the kernel instead, copied in or out with copyuser().
+// Small transfers use one on the stack.
+#define SMALLCOPY 128
+
+static char*
+bounce(int n, char *small, int *size)
+{
+  char *b;
+
+  if(n > SMALLCOPY && (b = kalloc()) != 0){
+    *size = PGSIZE;
+    return b;
+  }
+  *size = SMALLCOPY;
+  return small;
+}
+
+// Put n bytes of kernel memory src into the ring, waiting
+// for room unless nonblock is set.  Returns the number put,
+// short if the reader has gone, we were killed, or the pipe
+// is full and nonblock is set.  Called with p->lock held.
+static int
+pipeput(struct pipe *p, char *src, int n, int nonblock)
 {
   int i;
+  uint off, m;
+
+  for(i = 0; i < n; i += m){
+    while(p->wbusy || p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+      if(p->readopen == 0 || myproc()->killed || nonblock)
+        return i;
+      if(p->rwait)
+        wakeupone(&p->nread);
+      p->wwait++;
+      sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->wwait--;
+    }
+    off = p->nwrite % PIPESIZE;
+    m = span(off, n - i);
+    if(m > p->nread + PIPESIZE - p->nwrite)
+      m = p->nread + PIPESIZE - p->nwrite;
+    memmove(p->data[off / PGSIZE] + off % PGSIZE, src + i, m);
+    p->nwrite += m;
+  }
+  return i;
+}
+
+//PAGEBREAK: 40
+// Write n bytes from user address addr, waiting for room
+// unless nonblock is set, in which case return what fit,
+// or -1 if nothing did.
+int
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
+{
+  char small[SMALLCOPY], *buf;
+  int i, m, r, size;
 
+  buf = bounce(n, small, &size);
+  i = 0;
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  while(i < n){
+    m = n - i < size ? n - i : size;
+    release(&p->lock);
+    r = copyuser(myproc()->mm, (uint)addr + i, buf, m, 0);
+    acquire(&p->lock);
+    if(r < 0)
+      break;
+    r = pipeput(p, buf, m, nonblock);
+    i += r;
+    if(r < m)
+      break;
+    // Let readers start on this part.
+    if(p->rwait)
+      wakeupone(&p->nread);
+  }
+  passturn(p);  //DOC: pipewrite-wakeup1
+  pollwake(&p->pollq);
+  release(&p->lock);
+  if(buf != small)
+    kfree(buf);
+  if(i < n && (!nonblock || i == 0))
+    return -1;
+  return i;
+}
+
+// Write n bytes of f's inode from f->off into the pipe,
+// reading the buffer cache straight into the ring.  The pipe
+// lock is dropped while the inode is locked and read, and
+// wbusy keeps other writers out of the ring meanwhile.
+// f->off advances under the inode lock, exclusive if excl,
+// as in fileread().  Returns the number of bytes moved,
+// short at end of file.
+int
+pipewritei(struct pipe *p, struct file *f, int excl, int n)
+{
+  int i, r;
+  uint o, m;
+
+  r = 0;
+  acquire(&p->lock);
+  for(i = 0; i < n; i += r){
+    while(p->wbusy || p->nwrite == p->nread + PIPESIZE){
       if(p->readopen == 0 || myproc()->killed){
+        passturn(p);
         release(&p->lock);
-        return -1;
+        return i > 0 ? i : -1;
       }
-      wakeup(&p->nread);
-      sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      if(p->rwait)
+        wakeupone(&p->nread);
+      p->wwait++;
+      sleep(&p->nwrite, &p->lock);
+      p->wwait--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    o = p->nwrite % PIPESIZE;
+    m = span(o, n - i);
+    if(m > p->nread + PIPESIZE - p->nwrite)
+      m = p->nread + PIPESIZE - p->nwrite;
+    p->wbusy = 1;
+    release(&p->lock);
+    if(excl)
+      ilock(f->ip);
+    else
+      ilockshared(f->ip);
+    if((r = readi(f->ip, p->data[o / PGSIZE] + o % PGSIZE, f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    acquire(&p->lock);
+    p->wbusy = 0;
+    if(r <= 0)
+      break;
+    p->nwrite += r;
+    if(p->rwait)
+      wakeupone(&p->nread);
+    pollwake(&p->pollq);
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  passturn(p);
+  pollwake(&p->pollq);
   release(&p->lock);
-  return n;
+  if(r < 0 && i == 0)
+    return -1;
+  return i;
 }
 
+// Read up to n bytes into user address addr, waiting for
+// some unless nonblock is set, in which case an empty pipe
+// returns -1.  Reads at most a bounce buffer's worth.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
-  int i;
+  char small[SMALLCOPY], *buf;
+  int i, size;
+  uint off, m;
 
+  buf = bounce(n, small, &size);
+  if(n > size)
+    n = size;
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-    if(myproc()->killed){
+    if(myproc()->killed || nonblock){
+      passturn(p);
       release(&p->lock);
+      if(buf != small)
+        kfree(buf);
       return -1;
     }
+    p->rwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    off = p->nread % PIPESIZE;
+    m = span(off, n - i);
+    if(m > p->nwrite - p->nread)
+      m = p->nwrite - p->nread;
+    memmove(buf + i, p->data[off / PGSIZE] + off % PGSIZE, m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  passturn(p);  //DOC: piperead-wakeup
+  pollwake(&p->pollq);
   release(&p->lock);
+  if(i > 0 && copyuser(myproc()->mm, (uint)addr, buf, i, 1) < 0)
+    i = -1;
+  if(buf != small)
+    kfree(buf);
   return i;
 }
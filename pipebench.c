@@ -0,0 +1,81 @@
+// Pipe throughput benchmark: a child writes TOTAL bytes into
+// a pipe in chunks of each size below, and the parent reads
+// them back.  Reports MB per second for each chunk size.
+//
+// usage: pipebench [kbytes]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+#define TOTAL (4*1024*1024)
+#define MAXCHUNK 16384
+
+char buf[MAXCHUNK];
+int chunks[] = { 1, 64, 512, 4096, 16384 };
+
+// Pass total bytes through a pipe in chunks of n.
+// Returns the microseconds taken.
+uint
+run(int n, int total)
+{
+  int fds[2], pid, got, r, left;
+  uint64 start;
+  uint rem;
+
+  if(pipe(fds) < 0){
+    printf(1, "pipebench: pipe failed\n");
+    exit();
+  }
+  start = nsec();
+  pid = fork();
+  if(pid < 0){
+    printf(1, "pipebench: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(left = total; left > 0; left -= n){
+      if(write(fds[1], buf, left < n ? left : n) < 0){
+        printf(1, "pipebench: write failed\n");
+        break;
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  got = 0;
+  while((r = read(fds[0], buf, n)) > 0)
+    got += r;
+  close(fds[0]);
+  wait();
+  if(got != total)
+    printf(1, "pipebench: read %d bytes, expected %d\n", got, total);
+  return divl(nsec() - start, 1000, &rem);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, total, len;
+  uint us;
+
+  total = TOTAL;
+  if(argc > 1)
+    total = atoi(argv[1]) * 1024;
+  if(total < 1)
+    total = 1024;
+  memset(buf, 'p', sizeof(buf));
+  for(i = 0; i < sizeof(chunks)/sizeof(chunks[0]); i++){
+    n = chunks[i];
+    // A byte at a time would take all day.
+    len = n == 1 ? total / 64 : total;
+    us = run(n, len);
+    if(us < 1)
+      us = 1;
+    printf(1, "%d-byte chunks: %d KB in %d us, %d MB/s\n", n,
+           len / 1024, us, len / us);
+  }
+  exit();
+}
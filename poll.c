@@ -0,0 +1,197 @@
+// Waiting on many descriptors at once.
+//
+// A process in poll() cannot sleep on the channels of all
+// its pipes and terminals at once.  Instead it hangs an
+// entry on the pollq of each pipe or device it watches,
+// and sleeps on a poller of its own.  Whatever can make a
+// descriptor ready calls pollwake() on its pollq, which
+// wakes just the processes polling that object.  It costs
+// a load when no one is polling it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+
+// A process in poll().
+struct poller {
+  uint seq;       // bumped by each pollwake() of a watched pollq
+};
+
+struct pollent {
+  struct poller *w;
+  struct pollq *q;
+  struct pollent *next;   // on q
+};
+
+// poll()'s working state, too big for the kernel stack.
+struct pollbuf {
+  struct pollfd fds[NPOLL];
+  struct file *f[NPOLL];        // held open until poll() returns
+  struct pollent ent[NPOLL];
+};
+
+// Guards every pollq's list and every poller's seq.
+struct spinlock polllock;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Something a poller of q may be waiting for has happened.
+// The caller holds the lock that guards the change, which
+// poll() takes to look at it after joining q, so the poller
+// either sees the change or is seen.
+void
+pollwake(struct pollq *q)
+{
+  struct pollent *e;
+
+  if(q->head == 0)
+    return;
+  acquire(&polllock);
+  for(e = q->head; e; e = e->next){
+    e->w->seq++;
+    wakeup(e->w);
+  }
+  release(&polllock);
+}
+
+// Join or leave the pollqs of b's files.
+static void
+pollregister(struct pollbuf *b, int nfds, struct poller *w)
+{
+  struct pollent *e;
+  struct pollq *q;
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < nfds; i++){
+    e = &b->ent[i];
+    e->w = w;
+    e->q = 0;
+    if(b->f[i] == 0 || (q = filepollq(b->f[i])) == 0)
+      continue;
+    e->q = q;
+    e->next = q->head;
+    q->head = e;
+  }
+  release(&polllock);
+}
+
+static void
+pollunregister(struct pollbuf *b, int nfds)
+{
+  struct pollent **pp;
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < nfds; i++){
+    if(b->ent[i].q == 0)
+      continue;
+    for(pp = &b->ent[i].q->head; *pp != &b->ent[i]; pp = &(*pp)->next)
+      ;
+    *pp = b->ent[i].next;
+  }
+  release(&polllock);
+}
+
+// Fill in revents for each of b's fds.
+// Returns the number with any set.
+static int
+pollscan(struct pollbuf *b, int nfds)
+{
+  struct pollfd *pf;
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < nfds; i++){
+    pf = &b->fds[i];
+    pf->revents = 0;
+    if(pf->fd < 0)
+      continue;
+    if(b->f[i] == 0)
+      pf->revents = POLLNVAL;
+    else
+      pf->revents = filepoll(b->f[i]) & (pf->events | POLLHUP);
+    if(pf->revents)
+      n++;
+  }
+  return n;
+}
+
+// Wait until one of the nfds user pollfds at ufds is
+// ready, or for timeout ticks; a negative timeout waits
+// for ever.  Returns the number of fds ready, 0 on
+// timeout, -1 if killed or ufds is bad.
+int
+poll(struct pollfd *ufds, int nfds, int timeout)
+{
+  struct proc *p;
+  struct files *fs;
+  struct pollbuf *b;
+  struct poller w;
+  uint seq, start;
+  int i, n, fd;
+
+  p = myproc();
+  fs = p->files;
+  if((b = (struct pollbuf*)kalloc()) == 0)
+    return -1;
+  n = nfds * sizeof(struct pollfd);
+  if(copyuser(p->mm, (uint)ufds, (char*)b->fds, n, 0) < 0){
+    kfree((char*)b);
+    return -1;
+  }
+
+  // Hold the files, so another thread's close() cannot
+  // free a pipe while we are on its pollq.
+  acquire(&fs->lock);
+  for(i = 0; i < nfds; i++){
+    fd = b->fds[i].fd;
+    b->f[i] = 0;
+    if(fd >= 0 && fd < NOFILE && fs->ofile[fd])
+      b->f[i] = filedup(fs->ofile[fd]);
+  }
+  release(&fs->lock);
+
+  w.seq = 0;
+  pollregister(b, nfds, &w);
+  start = ticks;
+  acquire(&polllock);
+  for(;;){
+    seq = w.seq;
+    release(&polllock);
+    n = pollscan(b, nfds);
+    acquire(&polllock);
+    if(n > 0 || timeout == 0 || p->killed)
+      break;
+    if(w.seq != seq)
+      continue;   // something changed while we looked
+    if(timeout < 0)
+      sleep(&w, &polllock);
+    else if(ticks - start >= timeout)
+      break;
+    else
+      sleeptimeout(&w, &polllock, timeout - (ticks - start));
+  }
+  release(&polllock);
+  pollunregister(b, nfds);
+
+  for(i = 0; i < nfds; i++)
+    if(b->f[i])
+      fileclose(b->f[i]);
+  if(p->killed ||
+     copyuser(p->mm, (uint)ufds, (char*)b->fds, nfds * sizeof(struct pollfd), 1) < 0)
+    n = -1;
+  kfree((char*)b);
+  return n;
+}
@@ -0,0 +1,13 @@
+// Descriptors and events for poll().
+struct pollfd {
+  int fd;           // ignored if negative
+  short events;     // wanted: POLLIN, POLLOUT
+  short revents;    // ready, plus POLLHUP and POLLNVAL
+};
+
+#define POLLIN   0x001  // read will not block
+#define POLLOUT  0x004  // write will not block
+#define POLLHUP  0x010  // the other end of the pipe is closed
+#define POLLNVAL 0x020  // fd is not open
+
+#define NPOLL 64  // most descriptors in one call
@@ -0,0 +1,132 @@
+// poll() and O_NONBLOCK test: one process services several
+// producers, each writing messages into its own pipe at its
+// own pace.  Checks that every message arrives, and reports
+// how many poll() calls that took.  Also checks that empty
+// and full non-blocking pipes return at once.
+//
+// usage: polltest [producers] [messages]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "poll.h"
+
+#define NPROD 4
+#define MAXPROD 8     // a read end each, within NOFILE
+#define NMSG 100
+#define MSGSIZE 32
+
+char buf[4096];
+
+void
+fail(char *s)
+{
+  printf(1, "polltest: %s\n", s);
+  exit();
+}
+
+void
+nonblocking(void)
+{
+  int fds[2], n, tot;
+
+  if(pipe(fds) < 0)
+    fail("pipe failed");
+  if(fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0)
+    fail("fcntl failed");
+  if(!(fcntl(fds[0], F_GETFL, 0) & O_NONBLOCK))
+    fail("F_GETFL lost O_NONBLOCK");
+  if(read(fds[0], buf, 1) != -1)
+    fail("read of empty pipe did not fail");
+  tot = 0;
+  while((n = write(fds[1], buf, sizeof(buf))) > 0)
+    tot += n;
+  if(tot == 0)
+    fail("write to empty pipe failed");
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    tot -= n;
+  if(tot != 0)
+    fail("lost bytes");
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "non-blocking pipe: ok\n");
+}
+
+void
+producer(int fd, int id, int nmsg)
+{
+  int i;
+
+  memset(buf, 'a' + id, MSGSIZE);
+  for(i = 0; i < nmsg; i++){
+    if(write(fd, buf, MSGSIZE) != MSGSIZE)
+      fail("producer write failed");
+    if(i % (id + 1) == 0)
+      sleep(1);
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pollfd pfd[MAXPROD];
+  int fds[2], got[MAXPROD], nprod, nmsg, open, calls, i, n, j;
+
+  nprod = NPROD;
+  nmsg = NMSG;
+  if(argc > 1)
+    nprod = atoi(argv[1]);
+  if(argc > 2)
+    nmsg = atoi(argv[2]);
+  if(nprod < 1 || nprod > MAXPROD)
+    nprod = NPROD;
+  if(nmsg < 1)
+    nmsg = NMSG;
+
+  nonblocking();
+
+  for(i = 0; i < nprod; i++){
+    if(pipe(fds) < 0)
+      fail("pipe failed");
+    if(fork() == 0){
+      close(fds[0]);
+      producer(fds[1], i, nmsg);
+    }
+    close(fds[1]);
+    pfd[i].fd = fds[0];
+    pfd[i].events = POLLIN;
+    got[i] = 0;
+  }
+
+  calls = 0;
+  for(open = nprod; open > 0; ){
+    if(poll(pfd, nprod, -1) < 1)
+      fail("poll failed");
+    calls++;
+    for(i = 0; i < nprod; i++){
+      if(pfd[i].revents == 0)
+        continue;
+      if((n = read(pfd[i].fd, buf, sizeof(buf))) > 0){
+        for(j = 0; j < n; j++)
+          if(buf[j] != 'a' + i)
+            fail("message in the wrong pipe");
+        got[i] += n;
+        continue;
+      }
+      close(pfd[i].fd);
+      pfd[i].fd = -1;
+      open--;
+    }
+  }
+  for(i = 0; i < nprod; i++){
+    wait();
+    if(got[i] != nmsg * MSGSIZE)
+      fail("messages lost");
+  }
+  printf(1, "%d producers, %d messages each: ok, %d poll calls\n",
+         nprod, nmsg, calls);
+  exit();
+}
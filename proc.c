@@ -4,26 +4,59 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
-
+#include "proc.h"
+#include "timer.h"
+#include "pstat.h"
+
+// The process table grows on demand: struct procs are carved
+// out of pages from kalloc() as needed, up to NPROC of them
+// live at once, and recycled through a free list.  Live
+// processes are on the list at ptable.all, and hashed by pid
+// for kill().  Each process lists its children, so that
+// wait() and exit() look only at those.
+//
+// ptable.lock protects allocation of procs, the lists and
+// the parent links between processes.  Each proc's own lock
+// protects its scheduling state; see sleep() and scheduler().
+// Lock order: ptable.lock, sleep queue lock, p->lock,
+// run queue lock, share table lock.
+#define NPIDHASH 61
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *all;                // through proc.next
+  struct proc *free;               // through proc.next
+  struct proc *pidhash[NPIDHASH];  // through proc.hnext
+  int nproc;                       // live procs
 } ptable;
 
+// Sleeping processes wait on one of NSLEEPQ queues, chosen
+// by hashing the channel, so that wakeup() only looks at
+// processes that might be sleeping on its channel.
+#define NSLEEPQ 61
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;  // through proc.sqnext, oldest first
+} sleepq[NSLEEPQ];
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
-
 void
 pinit(void)
 {
+  struct cpu *c;
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rq.lock, "runq");
+  for(i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
 }
 
 // Must be called with interrupts disabled
@@ -65,35 +98,373 @@ myproc(void) {
   return p;
 }
 
+//PAGEBREAK: 30
+// Run queues.
+//
+// Each CPU has its own queue of RUNNABLE processes.  A process
+// that wakes up or is preempted joins the queue of the CPU it
+// last ran on, whose caches may still hold its memory, and a
+// CPU with nothing to run steals from the busiest other queue.
+//
+// Queues are multi-level feedback queues.  A CPU runs the
+// oldest process of the highest priority level that has one.
+// A process starts at level 0 and drops a level each time it
+// uses up the time slice of its level, which doubles per level,
+// so CPU-bound processes sink while processes that mostly
+// sleep stay on top and run soon after they wake.  Sleeping
+// does not reset the slice, so a process can't stay on top by
+// sleeping just before its slice ends.  Every BOOSTTICKS all
+// processes go back to the top so that none starves.
+// A nice value keeps a process out of the top levels.
+// Levels only order the processes of one uid: which uid
+// runs is decided first, by fair share (see share.c).
+
+#define BOOSTTICKS 100
+#define QUANTUM(prio) (1 << (prio))
+
+// Highest level a process with the given nice value may use.
+static int
+nicelevel(int nice)
+{
+  return nice * NPRIO / (NICEMAX + 1);
+}
+
+static uint
+boostepoch(void)
+{
+  return ticks / BOOSTTICKS;
+}
+
+// Process p has been queued on c.  If c is halted, wake it with
+// a reschedule IPI; if c is running a process of lower priority,
+// interrupt it so that it yields; otherwise wake some other
+// halted CPU to steal p.  Must be called with interrupts disabled.
+static void
+kick(struct cpu *c, struct proc *p)
+{
+  struct cpu *c1;
+  struct proc *running;
+
+  if(c == mycpu())
+    return;
+  // Pairs with the barrier in idle(): either the halting CPU
+  // sees the queued process, or we see it idle.
+  __sync_synchronize();
+  if(!c->idle){
+    // c->proc may change under us; a wrong guess costs
+    // one spurious interrupt or a wait until the next tick.
+    running = c->proc;
+    if(running && running->prio > p->prio){
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+      return;
+    }
+    for(c1 = cpus; c1 < &cpus[ncpu]; c1++)
+      if(c1 != mycpu() && c1->idle)
+        break;
+    if(c1 == &cpus[ncpu])
+      return;
+    c = c1;
+  }
+  if(xchg(&c->idle, 0) == 0)
+    return;  // someone else woke it
+  c->kicked = rdtsc();
+  lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+static void runqput(struct runq*, struct proc*);
+static void unsleep(struct proc*);
+
+// Mark p RUNNABLE and put it on the run queue of p->cpu.
+// Caller must hold p->lock.
+static void
+makerunnable(struct proc *p)
+{
+  struct runq *rq;
+
+  if(!holding(&p->lock))
+    panic("makerunnable");
+  p->state = RUNNABLE;
+  p->readyat = ticks;
+  if(p->epoch != boostepoch()){
+    p->epoch = boostepoch();
+    p->prio = nicelevel(p->nice);
+    p->slice = 0;
+  }
+  rq = &cpus[p->cpu].rq;
+  acquire(&rq->lock);
+  runqput(rq, p);
+  release(&rq->lock);
+  kick(&cpus[p->cpu], p);
+}
+
+// Append p to its level of rq.  Caller must hold rq->lock.
+static void
+runqput(struct runq *rq, struct proc *p)
+{
+  p->rqnext = 0;
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+  rq->n++;
+}
+
+// Move every process on rq back to its highest level.
+// Caller must hold rq->lock.
+static void
+runqboost(struct runq *rq)
+{
+  struct proc *list[NPRIO], *p, *next;
+  int i;
+
+  for(i = 0; i < NPRIO; i++){
+    list[i] = rq->head[i];
+    rq->head[i] = rq->tail[i] = 0;
+  }
+  rq->n = 0;
+  for(i = 0; i < NPRIO; i++){
+    for(p = list[i]; p; p = next){
+      next = p->rqnext;
+      p->epoch = rq->epoch;
+      p->prio = nicelevel(p->nice);
+      p->slice = 0;
+      runqput(rq, p);
+    }
+  }
+}
+
+// Take the next process to run off rq, or return 0: of the
+// uid furthest behind its fair share (see share.c), the first
+// process of the highest level.  The process stays RUNNABLE,
+// and nothing else will touch its scheduling state until the
+// caller runs it.
+static struct proc*
+runqget(struct runq *rq)
+{
+  struct proc *p, *prev, *best, *bestprev;
+  uint pass, bestpass, passes[NSHARE];
+  int i, j, n, bestlevel, uids[NSHARE];
+
+  if(rq->n == 0)
+    return 0;
+  acquire(&rq->lock);
+  if(rq->epoch != boostepoch()){
+    rq->epoch = boostepoch();
+    runqboost(rq);
+  }
+  n = sharepasses(uids, passes, NSHARE);
+  best = bestprev = 0;
+  bestpass = bestlevel = 0;
+  for(i = 0; i < NPRIO; i++){
+    prev = 0;
+    for(p = rq->head[i]; p; prev = p, p = p->rqnext){
+      for(j = 0; j < n && uids[j] != p->uid; j++)
+        ;
+      pass = j < n ? passes[j] : sharepass(p->uid);
+      if(best == 0 || (int)(pass - bestpass) < 0){
+        best = p;
+        bestprev = prev;
+        bestpass = pass;
+        bestlevel = i;
+      }
+    }
+  }
+  if((p = best) != 0){
+    if(bestprev)
+      bestprev->rqnext = p->rqnext;
+    else
+      rq->head[bestlevel] = p->rqnext;
+    if(rq->tail[bestlevel] == p)
+      rq->tail[bestlevel] = bestprev;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Steal a process from the longest run queue other than c's.
+static struct proc*
+steal(struct cpu *c)
+{
+  struct cpu *c1, *busiest;
+
+  busiest = 0;
+  for(c1 = cpus; c1 < &cpus[ncpu]; c1++)
+    if(c1 != c && c1->rq.n > 0 && (busiest == 0 || c1->rq.n > busiest->rq.n))
+      busiest = c1;
+  if(busiest == 0)
+    return 0;
+  return runqget(&busiest->rq);
+}
+
+// Halt c until an interrupt arrives, unless some process is
+// waiting to run.  Called from scheduler() with interrupts
+// disabled; kick() wakes a halted CPU when there is work.
+static void
+idle(struct cpu *c)
+{
+  struct cpu *c1;
+  uint t;
+
+  c->kicked = 0;
+  c->idle = 1;
+  __sync_synchronize();
+  for(c1 = cpus; c1 < &cpus[ncpu]; c1++){
+    if(c1->rq.n > 0){
+      c->idle = 0;
+      return;
+    }
+  }
+  // sti takes effect after the next instruction, so no
+  // interrupt can arrive between it and hlt.
+  sti();
+  hlt();
+  cli();
+  c->idle = 0;
+  if(c->kicked){
+    t = rdtsc() - c->kicked;
+    c->kicked = 0;
+    c->wakeups++;
+    c->wakecycles += t;
+    if(t > c->maxwake)
+      c->maxwake = t;
+  }
+}
+
+// The CPU with the shortest run queue, for placing new processes.
+// Must be called with interrupts disabled.
+static int
+leastloaded(void)
+{
+  struct cpu *c, *best;
+
+  best = mycpu();
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    if(c->rq.n < best->rq.n)
+      best = c;
+  return best - cpus;
+}
+
+static struct proc**
+pidhash(int pid)
+{
+  return &ptable.pidhash[pid % NPIDHASH];
+}
+
+// Fill the free list with a page worth of procs.
+// Caller must hold ptable.lock.
+static int
+procgrow(void)
+{
+  struct proc *p, *end;
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  end = (struct proc*)mem + PGSIZE / sizeof(struct proc);
+  for(p = (struct proc*)mem; p < end; p++){
+    initlock(&p->lock, "proc");
+    p->next = ptable.free;
+    ptable.free = p;
+  }
+  return 0;
+}
+
+// Find the live process with the given pid.
+// Caller must hold ptable.lock.
+static struct proc*
+proclookup(int pid)
+{
+  struct proc *p;
+
+  for(p = *pidhash(pid); p; p = p->hnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Return p, whose state is UNUSED, to the free list.
+// Caller must hold ptable.lock.
+static void
+procfree(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = pidhash(p->pid); *pp != p; pp = &(*pp)->hnext)
+    ;
+  *pp = p->hnext;
+  if(p->next)
+    p->next->pprev = p->pprev;
+  *p->pprev = p->next;
+  p->next = ptable.free;
+  ptable.free = p;
+  p->pid = 0;
+  ptable.nproc--;
+}
+
+// Make p a child of parent.  Caller must hold ptable.lock.
+static void
+addchild(struct proc *parent, struct proc *p)
+{
+  p->parent = parent;
+  p->sibling = parent->children;
+  parent->children = p;
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
+// Take a proc off the free list, growing the table if
+// need be.  If there is one, change state to EMBRYO and
+// initialize state required to run in the kernel.
 // Otherwise return 0.
 static struct proc*
 allocproc(void)
 {
-  struct proc *p;
+  struct proc *p, **hp;
   char *sp;
 
   acquire(&ptable.lock);
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
+  if(ptable.nproc >= NPROC || (ptable.free == 0 && procgrow() < 0)){
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->next;
+  p->next = ptable.all;
+  if(p->next)
+    p->next->pprev = &p->next;
+  p->pprev = &ptable.all;
+  ptable.all = p;
+  ptable.nproc++;
 
-found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  hp = pidhash(p->pid);
+  p->hnext = *hp;
+  *hp = p;
+  p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->pinned = 0;
+  p->insyscall = 0;
+  p->thread = 0;
+  p->prio = 0;
+  p->slice = 0;
+  p->nice = 0;
+  p->epoch = boostepoch();
+  p->rtime = 0;
+  p->wtime = 0;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
+    acquire(&ptable.lock);
     p->state = UNUSED;
+    procfree(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -126,10 +497,10 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->mm = mmalloc()) == 0 || (p->files = filesalloc()) == 0)
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(p->mm->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->mm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -140,41 +511,115 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->files->cwd = namei("/");
   
   p->uid = 0;    // Первый процесс = root
   p->gid = 0;
+  sharejoin(p->uid);
+  uinfoset(p);
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
-  p->state = RUNNABLE;
+  p->cpu = cpuid();
+  makerunnable(p);
 
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *curproc = myproc();
+  struct mm *mm = curproc->mm;
 
-  sz = curproc->sz;
+  mmlock(mm);
+  sz = oldsz = mm->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n > MMAPBASE || (sz = allocuvm(mm->pgdir, sz, sz + n)) == 0){
+      mmunlock(mm);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Other threads may be using the memory.
+    unmapuvm(mm->pgdir, sz + n, sz);
+    tlbshootdown(mm);
+    if((sz = deallocuvm(mm->pgdir, sz, sz + n)) == 0){
+      mmunlock(mm);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  mm->sz = sz;
+  mmunlock(mm);
   switchuvm(curproc);
-  return 0;
+  return oldsz;
+}
+
+//PAGEBREAK!
+// File tables.  Like an mm, a struct files is shared by
+// the threads of a process.  kalloc() is the only
+// allocator, so each gets a whole page.
+
+struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+  if((fs = (struct files*)kalloc()) == 0)
+    return 0;
+  memset(fs, 0, sizeof(*fs));
+  initlock(&fs->lock, "files");
+  fs->ref = 1;
+  return fs;
+}
+
+// A new table with the same open files and directory,
+// for fork().
+static struct files*
+filescopy(struct files *fs)
+{
+  struct files *nfs;
+  int fd;
+
+  if((nfs = filesalloc()) == 0)
+    return 0;
+  acquire(&fs->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fs->ofile[fd])
+      nfs->ofile[fd] = filedup(fs->ofile[fd]);
+  nfs->cwd = idup(fs->cwd);
+  release(&fs->lock);
+  return nfs;
+}
+
+// Drop a thread's reference to fs; the last one closes
+// the files.  Must not be called inside a transaction.
+static void
+filesput(struct files *fs)
+{
+  int fd, ref;
+
+  acquire(&fs->lock);
+  ref = --fs->ref;
+  release(&fs->lock);
+  if(ref > 0)
+    return;
+  for(fd = 0; fd < NOFILE; fd++){
+    if(fs->ofile[fd]){
+      fileclose(fs->ofile[fd]);
+      fs->ofile[fd] = 0;
+    }
+  }
+  begin_op();
+  iput(fs->cwd);
+  end_op();
+  kfree((char*)fs);
 }
 
 // Create a new process copying p as the parent.
@@ -186,6 +631,7 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct mm *mm;
 
   // Allocate process.
   if((np = allocproc()) == 0){
@@ -193,117 +639,249 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
-    return -1;
+  if((np->mm = mmalloc()) == 0)
+    goto bad;
+  mm = curproc->mm;
+  mmlock(mm);
+  if(copyuvm(np->mm->pgdir, mm->pgdir, mm->sz, mm->vma) < 0){
+    mmunlock(mm);
+    goto bad;
+  }
+  np->mm->sz = mm->sz;
+  for(i = 0; i < NVMA; i++){
+    np->mm->vma[i] = mm->vma[i];
+    if(np->mm->vma[i].ip)
+      idup(np->mm->vma[i].ip);
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
+  mmunlock(mm);
+  if((np->files = filescopy(curproc->files)) == 0)
+    goto bad;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
-
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
   np->uid = curproc->uid;  // Наследуем UID от родителя
   np->gid = curproc->gid;  // Наследуем GID от родителя
+  sharejoin(np->uid);
+  uinfoset(np);
+  np->nice = curproc->nice;
+  np->prio = nicelevel(np->nice);
 
   acquire(&ptable.lock);
+  addchild(curproc, np);
+  release(&ptable.lock);
+
+  acquire(&np->lock);
+
+  np->cpu = leastloaded();
+  makerunnable(np);
+
+  release(&np->lock);
+
+  return pid;
+
+bad:
+  if(np->mm){
+    begin_op();
+    vmafree(np->mm->vma);
+    end_op();
+    mmput(np->mm);
+    np->mm = 0;
+  }
+  kfree(np->kstack);
+  np->kstack = 0;
+  acquire(&ptable.lock);
+  np->state = UNUSED;
+  procfree(np);
+  release(&ptable.lock);
+  return -1;
+}
+
+// Create a thread running fn(arg) on the user stack whose
+// top is stack, sharing the current process's memory, open
+// files and current directory.  The thread's parent is the
+// current process, which collects it with join().
+// Returns the thread's pid, or -1.
+int
+clone(uint fn, uint arg, uint stack)
+{
+  int pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  // Push arg and a fake return PC; returning from fn faults.
+  sp = stack - sizeof(ustack);
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg;
+  if(stack < sizeof(ustack) || pagefault(curproc->mm, sp, 1) < 0 ||
+     pagefault(curproc->mm, stack - 1, 1) < 0 ||
+     copyout(curproc->mm->pgdir, sp, ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
 
-  np->state = RUNNABLE;
+  np->mm = curproc->mm;
+  mmdup(np->mm);
+  np->files = curproc->files;
+  acquire(&np->files->lock);
+  np->files->ref++;
+  release(&np->files->lock);
+  np->thread = 1;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = sp;
 
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  pid = np->pid;
+  np->uid = curproc->uid;
+  np->gid = curproc->gid;
+  sharejoin(np->uid);
+  uinfoset(np);
+  np->nice = curproc->nice;
+  np->prio = nicelevel(np->nice);
+
+  acquire(&ptable.lock);
+  addchild(curproc, np);
   release(&ptable.lock);
 
+  acquire(&np->lock);
+  np->cpu = leastloaded();
+  makerunnable(np);
+  release(&np->lock);
+
   return pid;
 }
 
+// The threads of mm are down to one, whose ids can go back
+// in the uinfo page (see uinfoset()).  A thread that has
+// left mm in exit() has given up its files first, and one
+// that has left it in exec() has another mm.
+void
+mmsingle(struct mm *mm)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.all; p; p = p->next){
+    if(p->mm == mm && p->files != 0 && p->state != ZOMBIE){
+      uinfoset(p);
+      break;
+    }
+  }
+  release(&ptable.lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// When a process's original thread exits, the threads it
+// made with clone() are killed too.
 void
 exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
+  if(!curproc->thread && curproc->mm->users > 1){
+    acquire(&ptable.lock);
+    for(p = ptable.all; p; p = p->next){
+      if(p == curproc)
+        continue;
+      acquire(&p->lock);
+      if(p->mm != curproc->mm || p->state == ZOMBIE){
+        release(&p->lock);
+        continue;
+      }
+      p->killed = 1;
+      release(&p->lock);
+      unsleep(p);
     }
+    release(&ptable.lock);
   }
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+  // Close all open files, if no other thread uses them.
+  filesput(curproc->files);
+  curproc->files = 0;
+  mmexit(curproc->mm);
 
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+  while((p = curproc->children) != 0){
+    curproc->children = p->sibling;
+    addchild(initproc, p);
+    if(p->state == ZOMBIE)
+      wakeup(initproc);
   }
 
   // Jump into the scheduler, never to return.
+  // Once curproc->lock is held the parent cannot see
+  // ZOMBIE until sched() has left this stack.
+  acquire(&curproc->lock);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
-wait(void)
+// Wait for a child to exit and return its pid: if threads
+// is set, a thread sharing this process's memory, otherwise
+// a process.  Return -1 if there are no such children.
+static int
+reap(int threads, uint *stack)
 {
-  struct proc *p;
+  struct proc *p, **pp;
   int havekids, pid;
+  uint ustack;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through children looking for exited ones.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+    for(pp = &curproc->children; (p = *pp) != 0; pp = &p->sibling){
+      if(threads != (p->thread && p->mm == curproc->mm))
         continue;
       havekids = 1;
+      acquire(&p->lock);
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
+        ustack = p->ustack;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
+        mmput(p->mm);
+        p->mm = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
+        release(&p->lock);
+        *pp = p->sibling;
+        shareleave(p->uid);
+        procfree(p);
         release(&ptable.lock);
+        // *stack may have been paged out while we slept.
+        if(stack &&
+           copyuser(curproc->mm, (uint)stack, (char*)&ustack, sizeof(ustack), 1) < 0)
+          return -1;
         return pid;
       }
+      release(&p->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -317,14 +895,61 @@ wait(void)
   }
 }
 
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  return reap(0, 0);
+}
+
+// Wait for a thread made by clone() to exit and return its
+// pid, and the stack it was given in *stack.
+// Return -1 if this process has no threads.
+int
+join(uint *stack)
+{
+  return reap(1, stack);
+}
+
+// Make p, taken off a run queue and locked, the current
+// process of c.
+static void
+runon(struct cpu *c, struct proc *p)
+{
+  if(p->state != RUNNABLE)
+    panic("runon: not runnable");
+  p->cpu = c - cpus;
+  p->wtime += ticks - p->readyat;
+  c->proc = p;
+  p->state = RUNNING;
+}
+
+// Finish a direct switch: the process we came from can be
+// unlocked now that we are off its stack.  Called by the
+// process switched to, at the end of sched() or in forkret().
+static void
+switchdone(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev;
+
+  if((prev = c->prev) != 0){
+    c->prev = 0;
+    release(&prev->lock);
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose a process to run from this CPU's run queue,
+//      or steal one from another CPU's
 //  - swtch to start running that process
 //  - eventually that process transfers control
-//      via swtch back to the scheduler.
+//      via swtch back to the scheduler, perhaps after
+//      handing the CPU directly to other processes.
 void
 scheduler(void)
 {
@@ -336,46 +961,59 @@ scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    cli();
+    if((p = runqget(&c->rq)) == 0 && (p = steal(c)) == 0){
+      idle(c);
+      continue;
     }
-    release(&ptable.lock);
 
+    // Switch to chosen process.  It is the process's job
+    // to release p->lock and then reacquire it
+    // before jumping back to us.
+    acquire(&p->lock);
+    runon(c, p);
+    switchuvm(p);
+
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // It need not be the process we switched to.
+    p = c->proc;
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
 // break in the few places where a lock is held but
 // there's no process.
+//
+// If a process is waiting on this CPU's run queue, switch
+// straight to it rather than through scheduler(): one swtch()
+// and one page table load instead of two each.  Its lock is
+// taken here and ours is released by it, in switchdone(),
+// once we are off our stack.  Processes on this CPU's queue
+// are not running anywhere else, so whoever holds the lock
+// of the one we pick is not waiting for ours.  That is not
+// so for other CPUs' queues, where a yielding process holds
+// its own lock until it is off its stack, so stealing is
+// left to scheduler(), which holds no process lock.
 void
 sched(void)
 {
   int intena;
   struct proc *p = myproc();
+  struct proc *np;
+  struct cpu *c;
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -383,18 +1021,121 @@ sched(void)
   if(readeflags()&FL_IF)
     panic("sched interruptible");
   intena = mycpu()->intena;
-  swtch(&p->context, mycpu()->scheduler);
+  c = mycpu();
+  if((np = runqget(&c->rq)) == 0){
+    swtch(&p->context, c->scheduler);
+  } else if(np == p){
+    // We were requeued by yield() and are still the best.
+    runon(c, p);
+  } else {
+    acquire(&np->lock);
+    runon(c, np);
+    switchuvm(np);
+    c->prev = p;
+    swtch(&p->context, np->context);
+  }
+  // However we left, we may be back by another process's
+  // direct switch, with its lock still to release.
+  switchdone();
   mycpu()->intena = intena;
 }
 
+// Called from trap() on the clock tick (if tick is set) or a
+// reschedule IPI, while the current process is running.
+// Charges the tick to it, and returns 1 if it should yield:
+// its time slice is used up, which also drops it a level,
+// or a process of higher priority is waiting.
+int
+shouldyield(int tick)
+{
+  struct proc *p;
+  struct runq *rq;
+  int i, r;
+
+  pushcli();
+  p = myproc();
+  rq = &mycpu()->rq;
+  r = 0;
+  if(tick){
+    p->rtime++;
+    sharecharge(p->uid);
+    if(++p->slice >= QUANTUM(p->prio)){
+      p->slice = 0;
+      if(p->prio < NPRIO-1)
+        p->prio++;
+      r = 1;
+    }
+  }
+  // Reading the queue heads without the lock is only a hint.
+  for(i = 0; i < p->prio && !r; i++)
+    if(rq->head[i])
+      r = 1;
+  popcli();
+  return r;
+}
+
+// Change the nice value of the current process by inc.
+// Only root may lower it.  Returns the new value, or -1.
+int
+nice(int inc)
+{
+  struct proc *p = myproc();
+  int n;
+
+  n = p->nice + inc;
+  if(n < 0)
+    n = 0;
+  if(n > NICEMAX)
+    n = NICEMAX;
+  if(n < p->nice && p->uid != 0)
+    return -1;
+  p->nice = n;
+  if(p->prio < nicelevel(n))
+    p->prio = nicelevel(n);
+  return n;
+}
+
+// Fill ps with the statistics of up to n live processes,
+// after skipping the first skip.  Returns how many were
+// filled.  ps must be kernel memory: user memory could fault
+// with ptable.lock held.
+int
+getpinfo(struct pstat *ps, int skip, int n)
+{
+  struct proc *p;
+  int i;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.all; p && i < n; p = p->next){
+    if(p->state == EMBRYO)
+      continue;
+    if(skip > 0){
+      skip--;
+      continue;
+    }
+    ps[i].pid = p->pid;
+    safestrcpy(ps[i].name, p->name, sizeof(ps[i].name));
+    ps[i].prio = p->prio;
+    ps[i].nice = p->nice;
+    ps[i].rtime = p->rtime;
+    ps[i].wtime = p->wtime;
+    i++;
+  }
+  release(&ptable.lock);
+  return i;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&p->lock);  //DOC: yieldlock
+  makerunnable(p);
   sched();
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -403,8 +1144,9 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding p->lock from scheduler or sched().
+  switchdone();
+  release(&myproc()->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -418,12 +1160,20 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+static struct sleepq*
+sleepqof(void *chan)
+{
+  return &sleepq[((uint)chan ^ ((uint)chan >> 12)) % NSLEEPQ];
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q;
+  struct proc **pp;
   
   if(p == 0)
     panic("sleep");
@@ -431,19 +1181,24 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  // Must acquire chan's queue lock in order to join the
+  // queue, and p->lock in order to change p->state and
+  // then call sched.  Once we hold the queue lock, we can
+  // be guaranteed that we won't miss any wakeup
+  // (wakeup locks the queue), so it's okay to release lk.
+  q = sleepqof(chan);
+  acquire(&q->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
+  release(lk);
+
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sqnext = 0;
+  for(pp = &q->head; *pp; pp = &(*pp)->sqnext)
+    ;
+  *pp = p;
+  release(&q->lock);
 
   sched();
 
@@ -451,32 +1206,114 @@ sleep(void *chan, struct spinlock *lk)
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
+  release(&p->lock);
+  acquire(lk);
+}
+
+// Take p off sleep queue q.  Caller must hold q->lock.
+static void
+sqremove(struct sleepq *q, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &q->head; *pp; pp = &(*pp)->sqnext){
+    if(*pp == p){
+      *pp = p->sqnext;
+      return;
+    }
   }
+  panic("sqremove");
 }
 
-//PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// Wake p if it is sleeping, whatever it is sleeping on.
+// Its queue must be locked first, and p might wake up
+// meanwhile.
 static void
-wakeup1(void *chan)
+unsleep(struct proc *p)
 {
-  struct proc *p;
+  struct sleepq *q;
+  void *chan;
+
+  acquire(&p->lock);
+  chan = p->state == SLEEPING ? p->chan : 0;
+  release(&p->lock);
+  if(chan == 0)
+    return;
+
+  q = sleepqof(chan);
+  acquire(&q->lock);
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    sqremove(q, p);
+    makerunnable(p);
+  }
+  release(&p->lock);
+  release(&q->lock);
+}
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+static void
+sleeptimedout(void *p)
+{
+  unsleep(p);
+}
+
+// Like sleep(), but give up after n ticks.
+// Returns 0 if woken, -1 if the time ran out.
+int
+sleeptimeout(void *chan, struct spinlock *lk, uint n)
+{
+  struct timer t;
+
+  t.fn = sleeptimedout;
+  t.arg = myproc();
+  t.pprev = 0;
+  timeradd(&t, n);
+  sleep(chan, lk);
+  return timerdel(&t) ? 0 : -1;
+}
+
+//PAGEBREAK!
+// Wake up processes sleeping on chan: all of them, or
+// if one is set just the one that has slept longest.
+static void
+wakeupchan(void *chan, int one)
+{
+  struct sleepq *q;
+  struct proc *p, **pp;
+
+  q = sleepqof(chan);
+  acquire(&q->lock);
+  pp = &q->head;
+  while((p = *pp) != 0){
+    if(p->chan != chan){
+      pp = &p->sqnext;
+      continue;
+    }
+    *pp = p->sqnext;
+    acquire(&p->lock);
+    makerunnable(p);
+    release(&p->lock);
+    if(one)
+      break;
+  }
+  release(&q->lock);
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  wakeupchan(chan, 0);
+}
+
+// Wake up one process sleeping on chan, for waiters that
+// each consume what they were waiting for.  A waiter woken
+// this way that leaves something for the others must wake
+// the next one itself.
+void
+wakeupone(void *chan)
+{
+  wakeupchan(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -488,18 +1325,78 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = proclookup(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
   }
+  acquire(&p->lock);
+  p->killed = 1;
+  release(&p->lock);
+  // Wake process from sleep if necessary.
+  unsleep(p);
   release(&ptable.lock);
-  return -1;
+  return 0;
+}
+
+// Page out one user page, for kallocswap().  The page is
+// chosen by a CLOCK sweep over the memory of processes that
+// are blocked, or preempted in user mode.
+// Returns 0 if a page was freed, -1 if there was none to take.
+int
+swapout(void)
+{
+  static struct proc *hand;  // protected by swaplock()
+  static uint handva;
+  struct proc *p;
+  uint pa;
+  int s, n;
+
+  if((s = swapalloc()) < 0)
+    return -1;
+  swaplock();
+
+  // Twice around the process list, so that a page passed over
+  // for its accessed bit on the first trip can be taken on the
+  // second.  ptable.lock keeps the list still, and holding
+  // p->lock keeps p from starting to run meanwhile.  The hand
+  // starts over if its process has been freed.
+  pa = 0;
+  acquire(&ptable.lock);
+  if(hand == 0 || hand->state == UNUSED){
+    hand = ptable.all;
+    handva = 0;
+  }
+  for(n = 0; n <= 2*ptable.nproc; n++){
+    p = hand;
+    acquire(&p->lock);
+    // Threads sharing an mm may be running it elsewhere.
+    // A process preempted in a system call may be about to
+    // use memory the call checked, with locks held, but one
+    // asleep in a call will check again (see copyuser()).
+    // A page fault or anything else holding the mm lock may
+    // be changing the page table.
+    // Test the state first: an EMBRYO or reaped proc has no mm.
+    if(((p->state == RUNNABLE && !p->insyscall) || p->state == SLEEPING) &&
+       p->pinned == 0 && p->mm->users == 1 && !p->mm->locked)
+      pa = pagevictim(p->mm, &handva, s);
+    release(&p->lock);
+    if(pa != 0)
+      break;
+    handva = 0;
+    if((hand = hand->next) == 0)
+      hand = ptable.all;
+  }
+  release(&ptable.lock);
+  if(pa == 0){
+    swapunlock();
+    swapfree(s);
+    return -1;
+  }
+
+  swapwrite(s, P2V(pa));
+  swapunlock();
+  kfree(P2V(pa));
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -522,9 +1419,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
+  for(p = ptable.all; p; p = p->next){
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
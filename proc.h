@@ -1,3 +1,13 @@
+// Queues of RUNNABLE processes waiting for a CPU,
+// one per priority level.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];    // Linked through proc.rqnext
+  struct proc *tail[NPRIO];
+  volatile int n;              // Length; read without the lock as a hint
+  uint epoch;                  // Last priority boost applied
+};
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,6 +18,19 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct proc *prev;           // Switched away from directly, see sched()
+  struct runq rq;              // Processes to run on this cpu
+  volatile uint idle;          // Halted in scheduler, waiting for work?
+  volatile uint kicked;        // TSC when sent a reschedule IPI, or 0
+  volatile uint tlbreq;        // TLB shootdowns asked of this cpu
+  volatile uint tlbdone;       // and done, see tlbshootdown()
+
+  // Statistics, see sys_cpustat().
+  uint busyticks;              // Clock ticks that found a process running
+  uint idleticks;              // Clock ticks that found none
+  uint wakeups;                // Wakeups from halt by reschedule IPI
+  uint wakecycles;             // Total TSC cycles from IPI to scheduler
+  uint maxwake;                // Longest of those
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,21 +57,78 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
-struct proc {
+// A region of user memory whose pages are filled in on first
+// access by pagefault() rather than up front.
+// Bytes [start, start+filesz) come from ip at offset off;
+// the rest of the region reads as zeros.
+struct vma {
+  uint start;                  // First address (page aligned)
+  uint end;                    // One past last address; start==end if unused
+  int flags;                   // VMA_WRITE, VMA_SHARED
+  struct inode *ip;            // Backing file, or 0 for zero-fill
+  uint off;                    // File offset of start
+  uint filesz;                 // Bytes of file content in the region
+};
+
+#define VMA_WRITE  0x1         // Region may be written
+#define VMA_SHARED 0x2         // Writes go to the file and are seen by fork children
+
+// An address space, shared by the threads of a process
+// (see clone()).  mmlock() serializes changes to it.
+struct mm {
+  struct spinlock lk;          // Protects locked
+  int locked;                  // Held by mmlock()?
+  int users;                   // Live threads using it
+  int ref;                     // Procs pointing at it, live or zombie
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
+  struct vma vma[NVMA];        // Lazily mapped regions
+  struct uinfo *uinfo;         // Kernel address of the UINFO page
+};
+
+// Open files and current directory, shared by the
+// threads of a process.
+struct files {
+  struct spinlock lock;        // Protects ref, ofile[], cwd
+  int ref;
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
+// Per-process state
+struct proc {
+  struct spinlock lock;        // Protects state, killed, rqnext
+
+  struct mm *mm;               // Address space
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *children;       // Child processes, through sibling
+  struct proc *sibling;        // Next child of parent
+  struct proc *next;           // Live or free process list
+  struct proc **pprev;
+  struct proc *hnext;          // Next in pid hash chain
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and current directory
   char name[16];               // Process name (debugging)
+  int thread;                  // Made by clone(); see join()
+  uint ustack;                 // Stack passed to clone(), for join()
+  int pinned;                  // In a page fault; don't page out
+  int insyscall;               // In a system call
+  struct proc *rqnext;         // Next on run queue
+  struct proc *sqnext;         // Next on sleep queue
+  int cpu;                     // Run queue to join: the cpu it last ran on
+  int prio;                    // Priority level, 0 is highest
+  int slice;                   // Ticks used at this level
+  int nice;                    // 0..NICEMAX; limits the highest level
+  uint epoch;                  // Last priority boost applied
+  uint rtime;                  // Ticks spent running
+  uint wtime;                  // Ticks spent runnable, waiting for a CPU
+  uint readyat;                // When last made runnable
 			       
   // === НОВЫЕ ПОЛЯ ===
   int uid;                     // User ID (0 = root)
@@ -0,0 +1,16 @@
+// Per-process scheduler statistics, see getpinfo().
+struct pstat {
+  int pid;
+  char name[16];
+  int prio;        // priority level, 0 is highest
+  int nice;
+  uint rtime;      // ticks spent running
+  uint wtime;      // ticks spent runnable, waiting for a CPU
+};
+
+// Per-uid fair-share statistics, see getshares().
+struct ushare {
+  int uid;
+  int shares;      // relative CPU share
+  uint usage;      // ticks charged to the uid
+};
@@ -0,0 +1,123 @@
+// Parallel word count: count the lines, words and bytes of
+// a file copied over and over into a large buffer, splitting
+// the buffer among threads.  Runs with 1, 2, 4, ... threads
+// up to the number asked for, to see how it scales with CPUS.
+//
+// usage: pwc [file [maxthreads]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define MAXTHREAD 8
+#define BUFSIZE   (4*1024*1024)
+#define NPASS     4
+
+char *buf;
+uint len;
+int nthread;
+
+// One cache line per thread, so the threads don't share lines.
+struct count {
+  uint lines, words, bytes;
+  char pad[64 - 3*sizeof(uint)];
+} counts[MAXTHREAD];
+
+int
+isspace(char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v';
+}
+
+void
+counter(void *arg)
+{
+  int i, pass, inword;
+  uint j, lo, hi, lines, words;
+
+  i = (int)arg;
+  lo = len / nthread * i;
+  hi = i == nthread-1 ? len : len / nthread * (i+1);
+  lines = words = 0;
+  for(pass = 0; pass < NPASS; pass++){
+    // A word that starts before lo is the previous thread's.
+    inword = lo > 0 && !isspace(buf[lo-1]);
+    for(j = lo; j < hi; j++){
+      if(buf[j] == '\n')
+        lines++;
+      if(isspace(buf[j]))
+        inword = 0;
+      else if(!inword){
+        words++;
+        inword = 1;
+      }
+    }
+  }
+  counts[i].lines = lines / NPASS;
+  counts[i].words = words / NPASS;
+  counts[i].bytes = hi - lo;
+}
+
+void
+fill(char *file)
+{
+  int fd, n;
+
+  len = 0;
+  while(len < BUFSIZE){
+    if((fd = open(file, O_RDONLY)) < 0){
+      printf(2, "pwc: cannot open %s\n", file);
+      exit();
+    }
+    while(len < BUFSIZE && (n = read(fd, buf + len, BUFSIZE - len)) > 0)
+      len += n;
+    close(fd);
+    if(len == 0){
+      printf(2, "pwc: %s is empty\n", file);
+      exit();
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *file;
+  int max, i;
+  uint start, end, lines, words, bytes;
+
+  file = argc > 1 ? argv[1] : "README";
+  max = argc > 2 ? atoi(argv[2]) : 4;
+  if(max < 1 || max > MAXTHREAD)
+    max = MAXTHREAD;
+
+  if((buf = malloc(BUFSIZE)) == 0){
+    printf(2, "pwc: out of memory\n");
+    exit();
+  }
+  fill(file);
+
+  for(nthread = 1; nthread <= max; nthread *= 2){
+    start = uptime();
+    for(i = 0; i < nthread; i++){
+      if(thread_create(counter, (void*)i) < 0){
+        printf(2, "pwc: thread_create failed\n");
+        exit();
+      }
+    }
+    for(i = 0; i < nthread; i++)
+      thread_join();
+    end = uptime();
+
+    lines = words = bytes = 0;
+    for(i = 0; i < nthread; i++){
+      lines += counts[i].lines;
+      words += counts[i].words;
+      bytes += counts[i].bytes;
+    }
+    printf(1, "%d threads: %d %d %d in %d ticks\n", nthread,
+           lines, words, bytes, end - start);
+  }
+  exit();
+}
@@ -0,0 +1,111 @@
+// Parallel read benchmark: 1, 2, 4 and 8 processes at once
+// read the same file, each through its own descriptor, over
+// and over.  The file's blocks stay in the buffer cache, so
+// the readers contend only for the inode lock, which they
+// can share.  Reports total throughput in KB per tick.
+//
+// usage: readbench [passes-per-process]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define FILESIZE (8*1024)    // fits in the buffer cache
+#define NPASS 50
+#define MAXPROC 8
+
+char *file = "readbench.tmp";
+char buf[512];
+
+void
+makefile(void)
+{
+  int fd, i;
+
+  if((fd = open(file, O_CREATE|O_RDWR)) < 0){
+    printf(1, "readbench: cannot create %s\n", file);
+    exit();
+  }
+  memset(buf, 'r', sizeof(buf));
+  for(i = 0; i < FILESIZE/sizeof(buf); i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "readbench: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+}
+
+void
+reader(int npass)
+{
+  int fd, i;
+
+  for(i = 0; i < npass; i++){
+    if((fd = open(file, O_RDONLY)) < 0){
+      printf(1, "readbench: cannot open %s\n", file);
+      exit();
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+}
+
+// Run n readers, started together through a pipe.
+// Returns the ticks taken.
+int
+run(int n, int npass)
+{
+  int go[2], i, pid;
+  uint start;
+  char c;
+
+  if(pipe(go) < 0){
+    printf(1, "readbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "readbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(go[1]);
+      read(go[0], &c, 1);
+      reader(npass);
+      exit();
+    }
+  }
+  close(go[0]);
+  start = uptime();
+  close(go[1]);
+  for(i = 0; i < n; i++)
+    wait();
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, t, npass, kb;
+
+  npass = NPASS;
+  if(argc > 1)
+    npass = atoi(argv[1]);
+  if(npass < 1)
+    npass = 1;
+  makefile();
+  reader(1);  // warm the buffer cache
+  for(n = 1; n <= MAXPROC; n *= 2){
+    t = run(n, npass);
+    if(t < 1)
+      t = 1;
+    kb = n * npass * (FILESIZE/1024);
+    printf(1, "%d readers: %d KB in %d ticks, %d KB/tick\n", n, kb, t, kb/t);
+  }
+  unlink(file);
+  exit();
+}
@@ -0,0 +1,100 @@
+// Scheduler benchmark: fork throughput and context switches
+// with several processes working at once.  Run it with
+// different CPUS= settings to see how the scheduler scales.
+//
+// usage: schedbench [nworkers [iterations]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NWORKER 8
+#define NITER   200
+
+// Each worker forks and reaps n children.
+void
+forker(int n)
+{
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "schedbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  exit();
+}
+
+// Each worker is a pair of processes passing a byte back
+// and forth over two pipes n times; every pass is a switch.
+void
+pingpong(int n)
+{
+  int ab[2], ba[2], i;
+  char c;
+
+  if(pipe(ab) < 0 || pipe(ba) < 0){
+    printf(1, "schedbench: pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    for(i = 0; i < n; i++){
+      if(read(ab[0], &c, 1) != 1)
+        break;
+      write(ba[1], &c, 1);
+    }
+    exit();
+  }
+  c = 'x';
+  for(i = 0; i < n; i++){
+    write(ab[1], &c, 1);
+    if(read(ba[0], &c, 1) != 1)
+      break;
+  }
+  wait();
+  exit();
+}
+
+void
+run(char *name, void (*fn)(int), int nworker, int niter)
+{
+  int i;
+  uint start, end;
+
+  start = uptime();
+  for(i = 0; i < nworker; i++){
+    if(fork() == 0)
+      fn(niter);
+  }
+  for(i = 0; i < nworker; i++)
+    wait();
+  end = uptime();
+  if(end == start)
+    end++;
+  printf(1, "%s: %d workers x %d in %d ticks, %d per tick\n", name,
+         nworker, niter, end - start, nworker * niter / (end - start));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nworker, niter;
+
+  nworker = NWORKER;
+  niter = NITER;
+  if(argc > 1)
+    nworker = atoi(argv[1]);
+  if(argc > 2)
+    niter = atoi(argv[2]);
+  if(nworker < 1)
+    nworker = 1;
+
+  run("fork+exit+wait", forker, nworker, niter);
+  run("pipe round trips", pingpong, nworker, niter * 10);
+  exit();
+}
@@ -0,0 +1,217 @@
+// Fair-share accounting by uid.
+//
+// CPU time is divided first among the uids that have
+// runnable processes, in proportion to their shares, and only
+// then among each uid's processes (by the priority levels in
+// proc.c).  This is stride scheduling: each uid has a pass
+// value that advances by STRIDE1/shares for every tick its
+// processes run, and a CPU picks a process of the uid with
+// the smallest pass.
+//
+// A uid that has been idle would otherwise come back with a
+// pass far behind everyone else's and take the CPU until it
+// caught up, so its pass is never allowed to fall more than
+// STRIDE1 behind vtime, the largest pass charged so far.
+//
+// An entry is kept while its uid has processes, counted by
+// sharejoin() and shareleave(), and after that only until
+// another uid needs the slot.
+//
+// Interface:
+// * sharepass() is the key the scheduler orders uids by, and
+//   sharepasses() gives it all of them at once.
+// * sharejoin() and shareleave() count a uid's processes.
+// * sharecharge() charges a clock tick to a uid.
+// * setshares() and getshares() back the system calls.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "pstat.h"
+
+#define STRIDE1   (1<<20)
+#define DEFSHARES 100
+#define MAXSHARES 10000
+
+struct share {
+  int uid;        // -1 if unused
+  int shares;
+  uint pass;
+  uint usage;     // ticks charged
+  int nproc;      // processes with this uid
+};
+
+struct {
+  struct spinlock lock;
+  struct share share[NSHARE];
+  struct share other;   // uids that don't fit in share[]
+  uint vtime;
+} stab;
+
+void
+shareinit(void)
+{
+  struct share *s;
+
+  initlock(&stab.lock, "share");
+  for(s = stab.share; s < &stab.share[NSHARE]; s++)
+    s->uid = -1;
+  stab.other.uid = -1;
+  stab.other.shares = DEFSHARES;
+}
+
+// Find uid's entry, making one if there is none, in an
+// unused slot or else in that of a uid with no processes.
+// Caller must hold stab.lock.
+static struct share*
+sharelookup(int uid)
+{
+  struct share *s, *empty, *idle;
+
+  empty = idle = 0;
+  for(s = stab.share; s < &stab.share[NSHARE]; s++){
+    if(s->uid == uid)
+      return s;
+    if(s->uid == -1 && empty == 0)
+      empty = s;
+    if(s->uid != -1 && s->nproc == 0 && idle == 0)
+      idle = s;
+  }
+  if(empty == 0)
+    empty = idle;
+  if(empty == 0)
+    return &stab.other;
+  empty->uid = uid;
+  empty->shares = DEFSHARES;
+  empty->pass = stab.vtime;
+  empty->usage = 0;
+  empty->nproc = 0;
+  return empty;
+}
+
+// Clamp s->pass so an idle uid can't bank more than
+// STRIDE1.  Caller must hold stab.lock.
+static void
+sharecatchup(struct share *s)
+{
+  if((int)(stab.vtime - s->pass) > STRIDE1)
+    s->pass = stab.vtime - STRIDE1;
+}
+
+// The pass of uid.  A smaller pass means uid is further
+// behind its share and should run first.
+uint
+sharepass(int uid)
+{
+  struct share *s;
+  uint pass;
+
+  acquire(&stab.lock);
+  s = sharelookup(uid);
+  sharecatchup(s);
+  pass = s->pass;
+  release(&stab.lock);
+  return pass;
+}
+
+// The passes of up to n uids with entries, into uid[] and
+// pass[], taking the lock just once.  Returns how many.
+int
+sharepasses(int *uid, uint *pass, int n)
+{
+  struct share *s;
+  int i;
+
+  i = 0;
+  acquire(&stab.lock);
+  for(s = stab.share; s < &stab.share[NSHARE] && i < n; s++){
+    if(s->uid == -1)
+      continue;
+    sharecatchup(s);
+    uid[i] = s->uid;
+    pass[i] = s->pass;
+    i++;
+  }
+  release(&stab.lock);
+  return i;
+}
+
+// A process with uid has been made, or has taken uid.
+void
+sharejoin(int uid)
+{
+  acquire(&stab.lock);
+  sharelookup(uid)->nproc++;
+  release(&stab.lock);
+}
+
+// A process with uid has gone, or has given up uid.
+// A uid that was put in stab.other while the table was
+// full may have its own entry by now, with its processes
+// not counted there.
+void
+shareleave(int uid)
+{
+  struct share *s;
+
+  acquire(&stab.lock);
+  s = sharelookup(uid);
+  if(s->nproc > 0)
+    s->nproc--;
+  release(&stab.lock);
+}
+
+// Charge a clock tick of CPU time to uid.
+void
+sharecharge(int uid)
+{
+  struct share *s;
+
+  acquire(&stab.lock);
+  s = sharelookup(uid);
+  sharecatchup(s);
+  if((int)(s->pass - stab.vtime) > 0)
+    stab.vtime = s->pass;
+  s->pass += STRIDE1 / s->shares;
+  s->usage++;
+  release(&stab.lock);
+}
+
+// Give uid n shares.  Returns -1 if n is out of range.
+int
+setshares(int uid, int n)
+{
+  struct share *s;
+
+  if(n < 1 || n > MAXSHARES)
+    return -1;
+  acquire(&stab.lock);
+  s = sharelookup(uid);
+  s->shares = n;
+  release(&stab.lock);
+  return 0;
+}
+
+// Fill us with up to n uids' shares and usage.
+// Returns how many were filled.  us must be kernel memory:
+// user memory could fault with stab.lock held.
+int
+getshares(struct ushare *us, int n)
+{
+  struct share *s;
+  int i;
+
+  i = 0;
+  acquire(&stab.lock);
+  for(s = stab.share; s < &stab.share[NSHARE] && i < n; s++){
+    if(s->uid == -1)
+      continue;
+    us[i].uid = s->uid;
+    us[i].shares = s->shares;
+    us[i].usage = s->usage;
+    i++;
+  }
+  release(&stab.lock);
+  return i;
+}
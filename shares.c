@@ -0,0 +1,35 @@
+// Show the CPU share and usage of each uid, or set a uid's share.
+//
+// usage: shares [uid nshares]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define NUS 16
+
+struct ushare us[NUS];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+
+  if(argc == 3){
+    if(setshares(atoi(argv[1]), atoi(argv[2])) < 0){
+      printf(2, "shares: cannot set shares of uid %s\n", argv[1]);
+      exit();
+    }
+    exit();
+  }
+  if(argc != 1){
+    printf(2, "usage: shares [uid nshares]\n");
+    exit();
+  }
+  n = getshares(us, NUS);
+  printf(1, "uid  shares  ticks\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%d  %d  %d\n", us[i].uid, us[i].shares, us[i].usage);
+  exit();
+}
@@ -1,4 +1,12 @@
 // Sleeping locks
+//
+// A sleep lock may be held exclusively, by acquiresleep(),
+// or shared by several readers, by acquiresleepshared().
+// New readers wait while a process waits for exclusive
+// access, so a stream of readers can't starve it.
+// releasesleep() releases either kind.  A shared hold is
+// timed from the first reader in to the last one out, the
+// time a writer would have had to wait.
 
 #include "types.h"
 #include "defs.h"
@@ -6,8 +14,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -16,18 +24,50 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
   lk->pid = 0;
+  lk->cls = lockclass(name, 1);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint t0, wait;
+  int contended;
+
   acquire(&lk->lk);
-  while (lk->locked) {
+  contended = lk->locked || lk->readers;
+  t0 = rdtsc();
+  lk->wwait++;
+  while (lk->locked || lk->readers) {
     sleep(lk, &lk->lk);
   }
+  lk->wwait--;
+  wait = rdtsc() - t0;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lockacquired(lk->cls, contended, wait);
+  lk->holdstart = rdtsc();
+  release(&lk->lk);
+}
+
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  uint t0, wait;
+  int contended;
+
+  acquire(&lk->lk);
+  contended = lk->locked || lk->wwait;
+  t0 = rdtsc();
+  while (lk->locked || lk->wwait) {
+    sleep(lk, &lk->lk);
+  }
+  wait = rdtsc() - t0;
+  if(lk->readers++ == 0)
+    lk->holdstart = rdtsc();
+  lockacquired(lk->cls, contended, wait);
   release(&lk->lk);
 }
 
@@ -35,12 +75,23 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if(lk->locked){
+    lockreleased(lk->cls, rdtsc() - lk->holdstart);
+    lk->locked = 0;
+    lk->pid = 0;
+    wakeup(lk);
+  } else {
+    if(lk->readers < 1)
+      panic("releasesleep");
+    if(--lk->readers == 0){
+      lockreleased(lk->cls, rdtsc() - lk->holdstart);
+      wakeup(lk);
+    }
+  }
   release(&lk->lk);
 }
 
+// Is the current process holding lk exclusively?
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -52,5 +103,19 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Is the current process holding lk either way?  Readers
+// aren't recorded, so for them this only says that someone
+// holds it shared.
+int
+holdingsleepany(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = (lk->locked && lk->pid == myproc()->pid) || lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
+
 
 
@@ -1,10 +1,16 @@
-// Long-term locks for processes
+// Long-term locks for processes.
+// Held either exclusively by one process, or shared by
+// any number of readers (see acquiresleepshared()).
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Processes holding it shared
+  int wwait;         // Processes waiting to hold it exclusively
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  int cls;           // Statistics class, see lockstat()
+  uint holdstart;    // TSC when acquired, or first shared
 };
 
@@ -1,4 +1,18 @@
 // Mutual exclusion spin locks.
+//
+// Ticket locks, so that waiting CPUs get the lock in turn
+// rather than whoever wins the next race for the cache line.
+// Waiters only read the lock until their turn comes, and back
+// off with pause in proportion to how many are ahead of them,
+// so the line is not pulled back and forth on every spin.
+// Build with -DLOCKDEBUG to record the caller's PCs in each
+// lock on acquire.
+//
+// Every lock also counts towards the statistics of its name
+// (its class), for finding contended locks: acquisitions,
+// how many had to wait and for how long, and the longest
+// hold.  Counters are kept per CPU so that CPUs don't fight
+// over them, and summed by lockstat().
 
 #include "types.h"
 #include "defs.h"
@@ -6,15 +20,159 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+
+// Pause loops per waiter ahead of us between looks at owner.
+#define BACKOFF 16
+
+#define NNAMECACHE 128  // power of two
+
+// Class 0 means not counted.
+static struct {
+  uint busy;     // xchg lock: initlock() runs before mycpu() works
+  int n;
+  struct {
+    char *name;
+    int sleep;
+  } cls[NLOCKCLASS];
+} lockclasses;
+
+// The class of each name pointer seen, so that locks made
+// again and again, like each pipe's and mm's, find theirs
+// without the lock or a strncmp.  A slot's class is set
+// before its name, and neither changes after, so readers
+// need no lock.
+static struct {
+  char *name[NNAMECACHE];
+  int cls[NNAMECACHE];
+} namecache[2];
+
+static struct lockcount {
+  uint acquires;
+  uint contended;
+  uint64 wait;
+  uint maxhold;
+} lockcount[NCPU][NLOCKCLASS];
+
+// The statistics class for locks called name, making one
+// if need be.  Returns 0 if the class table is full.
+int
+lockclass(char *name, int sleep)
+{
+  int i, h, j, k;
+  char *s;
+
+  h = ((uint)name >> 2) & (NNAMECACHE-1);
+  for(k = 0; k < NNAMECACHE; k++){
+    j = (h+k) & (NNAMECACHE-1);
+    if((s = namecache[sleep].name[j]) == name){
+      __sync_synchronize();
+      return namecache[sleep].cls[j];
+    }
+    if(s == 0)
+      break;
+  }
+
+  while(xchg(&lockclasses.busy, 1) != 0)
+    ;
+  for(i = 1; i <= lockclasses.n; i++)
+    if(lockclasses.cls[i].sleep == sleep &&
+       strncmp(lockclasses.cls[i].name, name, 16) == 0)
+      break;
+  if(i > lockclasses.n){
+    if(i < NLOCKCLASS){
+      lockclasses.n = i;
+      lockclasses.cls[i].name = name;
+      lockclasses.cls[i].sleep = sleep;
+    } else
+      i = 0;
+  }
+  // Another CPU may have cached name meanwhile; a second
+  // slot for it does no harm.
+  for(k = 0; k < NNAMECACHE; k++, h = (h+1) & (NNAMECACHE-1)){
+    if(namecache[sleep].name[h] == 0){
+      namecache[sleep].cls[h] = i;
+      __sync_synchronize();
+      namecache[sleep].name[h] = name;
+      break;
+    }
+  }
+  xchg(&lockclasses.busy, 0);
+  return i;
+}
+
+// Count an acquisition of a lock of class cls that waited
+// wait cycles, if contended.  Interrupts must be off.
+void
+lockacquired(int cls, int contended, uint wait)
+{
+  struct lockcount *lc;
+
+  if(cls == 0)
+    return;
+  lc = &lockcount[cpuid()][cls];
+  lc->acquires++;
+  if(contended){
+    lc->contended++;
+    lc->wait += wait;
+  }
+}
+
+// Count a release of a lock of class cls held for hold
+// cycles.  Interrupts must be off.
+void
+lockreleased(int cls, uint hold)
+{
+  struct lockcount *lc;
+
+  if(cls == 0)
+    return;
+  lc = &lockcount[cpuid()][cls];
+  if(hold > lc->maxhold)
+    lc->maxhold = hold;
+}
+
+// Fill ls with the statistics of up to n lock classes, and
+// start counting afresh if reset is set.  Returns how many
+// were filled.  ls must be kernel memory.
+int
+lockstat(struct lockstat *ls, int n, int reset)
+{
+  struct lockcount *lc;
+  uint64 wait;
+  int i, c;
+
+  for(i = 0; i < n && i < lockclasses.n; i++){
+    safestrcpy(ls[i].name, lockclasses.cls[i+1].name, sizeof(ls[i].name));
+    ls[i].sleep = lockclasses.cls[i+1].sleep;
+    ls[i].acquires = ls[i].contended = ls[i].maxhold = 0;
+    wait = 0;
+    for(c = 0; c < ncpu; c++){
+      lc = &lockcount[c][i+1];
+      ls[i].acquires += lc->acquires;
+      ls[i].contended += lc->contended;
+      wait += lc->wait;
+      if(lc->maxhold > ls[i].maxhold)
+        ls[i].maxhold = lc->maxhold;
+    }
+    ls[i].waitkc = wait >> 10;
+  }
+  // Counters bumped meanwhile by other CPUs may survive.
+  if(reset)
+    memset(lockcount, 0, sizeof(lockcount));
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->cls = lockclass(name, 0);
 }
 
 // Acquire the lock.
@@ -24,13 +182,26 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, owner, i, t0, wait;
+  int contended;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic.
+  ticket = xadd(&lk->next, 1);
+  contended = 0;
+  wait = 0;
+  if(lk->owner != ticket){
+    contended = 1;
+    t0 = rdtsc();
+    while((owner = lk->owner) != ticket){
+      for(i = (ticket - owner) * BACKOFF; i > 0; i--)
+        pause();
+    }
+    wait = rdtsc() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -39,7 +210,11 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
+#ifdef LOCKDEBUG
   getcallerpcs(&lk, lk->pcs);
+#endif
+  lockacquired(lk->cls, contended, wait);
+  lk->holdstart = rdtsc();
 }
 
 // Release the lock.
@@ -49,7 +224,10 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  lockreleased(lk->cls, rdtsc() - lk->holdstart);
+#ifdef LOCKDEBUG
   lk->pcs[0] = 0;
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +237,9 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Pass the lock to the next ticket.  Only the holder
+  // writes owner, so a plain aligned store is enough.
+  lk->owner = lk->owner + 1;
 
   popcli();
 }
@@ -91,7 +268,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
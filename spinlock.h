@@ -1,11 +1,19 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and waits
+// until owner reaches it, so CPUs get the lock in the order
+// they asked for it.  Free when next == owner.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;   // Next ticket to hand out
+  volatile uint owner;  // Ticket now holding the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  int cls;           // Statistics class, see lockstat()
+  uint holdstart;    // TSC when acquired
+#ifdef LOCKDEBUG
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+#endif
 };
 
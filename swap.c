@@ -0,0 +1,126 @@
+// Swap space.
+//
+// When memory runs out, kallocswap() pages out user pages
+// of other processes to a swap area on disk 0, after the
+// kernel image, and uses the freed memory.  A paged-out
+// page's PTE has PTE_P clear, PTE_SWAP set, and the swap
+// slot number where the page address would be; pagefault()
+// reads the page back in when the process touches it.
+//
+// Victims are chosen by swapout() in proc.c, with a CLOCK
+// sweep over all processes' page tables: a page whose
+// accessed bit is set gets a second chance.
+//
+// A slot is one disk block, so BSIZE must equal PGSIZE.
+// One buffer is used for all swap I/O; holding its sleep
+// lock also keeps a page from being read back in while it
+// is still being written out.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+struct {
+  struct spinlock lock;
+  int enabled;
+  uchar used[NSWAPBLOCKS/8];  // bitmap of slots in use
+  uint next;                  // where to start looking for a free slot
+  struct buf buf;
+} swap;
+
+// Called by ideinit() when there is a disk to swap to.
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.buf.lock, "swapbuf");
+  swap.buf.dev = SWAPDEV;
+  swap.enabled = 1;
+}
+
+// Allocate a page, paging out other processes' memory
+// if there is none free.  May sleep, so the caller must
+// not hold any spinlocks.
+char*
+kallocswap(void)
+{
+  char *mem;
+
+  while((mem = kalloc()) == 0)
+    if(!swap.enabled || swapout() < 0)
+      return 0;
+  return mem;
+}
+
+// Serialize swap I/O; see swapout().
+void
+swaplock(void)
+{
+  acquiresleep(&swap.buf.lock);
+}
+
+void
+swapunlock(void)
+{
+  releasesleep(&swap.buf.lock);
+}
+
+// Allocate a swap slot.  Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < NSWAPBLOCKS; i++){
+    s = (swap.next + i) % NSWAPBLOCKS;
+    if((swap.used[s/8] & (1 << (s%8))) == 0){
+      swap.used[s/8] |= 1 << (s%8);
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+void
+swapfree(uint s)
+{
+  acquire(&swap.lock);
+  if((swap.used[s/8] & (1 << (s%8))) == 0)
+    panic("swapfree");
+  swap.used[s/8] &= ~(1 << (s%8));
+  release(&swap.lock);
+}
+
+// Write page pg to slot s.  Caller must hold swaplock().
+void
+swapwrite(uint s, char *pg)
+{
+  if(!holdingsleep(&swap.buf.lock))
+    panic("swapwrite");
+  swap.buf.blockno = SWAPSTART + s;
+  memmove(swap.buf.data, pg, PGSIZE);
+  swap.buf.flags = B_DIRTY;
+  iderw(&swap.buf);
+}
+
+// Read slot s into page pg, waiting for any write
+// to it that is in progress.
+void
+swapread(uint s, char *pg)
+{
+  swaplock();
+  swap.buf.blockno = SWAPSTART + s;
+  swap.buf.flags = 0;
+  iderw(&swap.buf);
+  memmove(pg, swap.buf.data, PGSIZE);
+  swapunlock();
+}
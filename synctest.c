@@ -0,0 +1,215 @@
+// Tests for futexes and the mutexes, condition variables
+// and semaphores built on them, and a comparison of an
+// uncontended mutex with a pipe used as a lock.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+
+#define NTHREAD 4
+#define NITER 10000
+#define NITEM 1000
+#define NBENCH 100000
+#define NQUEUE 8
+
+struct mutex lock;
+struct cond notempty, notfull;
+struct sem items, slots;
+volatile uint counter;
+volatile uint word;
+int queue[NQUEUE], head, tail, count;
+int consumed;
+
+void
+fail(char *msg)
+{
+  printf(1, "synctest: %s FAILED\n", msg);
+  exit();
+}
+
+// Threads increment a counter non-atomically under a mutex.
+void
+adder(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    mutex_lock(&lock);
+    counter = counter + 1;
+    mutex_unlock(&lock);
+  }
+}
+
+void
+mutextest(void)
+{
+  int i;
+
+  mutex_init(&lock);
+  counter = 0;
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(adder, 0) < 0)
+      fail("thread_create");
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_join() < 0)
+      fail("thread_join");
+  if(counter != NTHREAD*NITER)
+    fail("mutex counter");
+  if(mutex_trylock(&lock) < 0)
+    fail("trylock free");
+  if(mutex_trylock(&lock) == 0)
+    fail("trylock held");
+  mutex_unlock(&lock);
+  printf(1, "mutex ok\n");
+}
+
+// Bounded queue with condition variables.
+void
+condproducer(void *arg)
+{
+  int i;
+
+  for(i = 1; i <= NITEM; i++){
+    mutex_lock(&lock);
+    while(count == NQUEUE)
+      cond_wait(&notfull, &lock);
+    queue[tail++ % NQUEUE] = i;
+    count++;
+    cond_signal(&notempty);
+    mutex_unlock(&lock);
+  }
+}
+
+void
+condtest(void)
+{
+  int i, sum;
+
+  mutex_init(&lock);
+  cond_init(&notempty);
+  cond_init(&notfull);
+  head = tail = count = 0;
+  if(thread_create(condproducer, 0) < 0)
+    fail("thread_create");
+  sum = 0;
+  for(i = 0; i < NITEM; i++){
+    mutex_lock(&lock);
+    while(count == 0)
+      cond_wait(&notempty, &lock);
+    sum += queue[head++ % NQUEUE];
+    count--;
+    cond_signal(&notfull);
+    mutex_unlock(&lock);
+  }
+  thread_join();
+  if(sum != NITEM*(NITEM+1)/2)
+    fail("cond queue");
+  printf(1, "cond ok\n");
+}
+
+// Bounded queue with semaphores, several consumers.
+void
+semconsumer(void *arg)
+{
+  for(;;){
+    sem_wait(&items);
+    mutex_lock(&lock);
+    if(queue[head % NQUEUE] == 0){
+      // End marker: leave it for the next consumer.
+      mutex_unlock(&lock);
+      sem_post(&items);
+      return;
+    }
+    head++;
+    consumed++;
+    mutex_unlock(&lock);
+    sem_post(&slots);
+  }
+}
+
+void
+semtest(void)
+{
+  int i;
+
+  mutex_init(&lock);
+  sem_init(&items, 0);
+  sem_init(&slots, NQUEUE);
+  head = tail = consumed = 0;
+  for(i = 0; i < NTHREAD; i++)
+    if(thread_create(semconsumer, 0) < 0)
+      fail("thread_create");
+  for(i = 1; i <= NITEM + 1; i++){
+    sem_wait(&slots);
+    queue[tail++ % NQUEUE] = i <= NITEM ? i : 0;
+    sem_post(&items);
+  }
+  for(i = 0; i < NTHREAD; i++)
+    thread_join();
+  if(consumed != NITEM)
+    fail("sem queue");
+  printf(1, "sem ok\n");
+}
+
+// futexwait() returns at once if the word has changed,
+// and gives up after its timeout.
+void
+futextest(void)
+{
+  uint t;
+
+  word = 1;
+  if(futexwait(&word, 0, 0) == 0)
+    fail("futexwait on changed word");
+  if(futexwake(&word, 1) != 0)
+    fail("futexwake with no waiters");
+  t = uptime();
+  if(futexwait(&word, 1, 5) == 0)
+    fail("futexwait timeout");
+  if(uptime() - t < 5)
+    fail("futexwait timeout too short");
+  printf(1, "futex ok\n");
+}
+
+// Uncontended lock and unlock: a mutex against a pipe
+// holding one token, the way a lock had to be made before.
+void
+bench(void)
+{
+  int fd[2], i;
+  uint t0, t1, t2;
+  char c;
+
+  mutex_init(&lock);
+  t0 = rdtsc();
+  for(i = 0; i < NBENCH; i++){
+    mutex_lock(&lock);
+    mutex_unlock(&lock);
+  }
+  t1 = rdtsc();
+  if(pipe(fd) < 0)
+    fail("pipe");
+  write(fd[1], "x", 1);
+  for(i = 0; i < NBENCH; i++){
+    read(fd[0], &c, 1);
+    write(fd[1], &c, 1);
+  }
+  t2 = rdtsc();
+  close(fd[0]);
+  close(fd[1]);
+  printf(1, "lock+unlock: mutex %d cycles, pipe %d cycles\n",
+         (t1 - t0) / NBENCH, (t2 - t1) / NBENCH);
+}
+
+int
+main(void)
+{
+  futextest();
+  mutextest();
+  condtest();
+  semtest();
+  bench();
+  exit();
+}
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -19,7 +20,7 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(addr >= curproc->mm->sz || addr+4 > curproc->mm->sz)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +35,10 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if(addr >= curproc->mm->sz)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
+  ep = (char*)curproc->mm->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -52,18 +53,54 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
+// Check that [va, va+size) lies within the process address
+// space, and fault it in now so that the kernel can use it
+// while holding locks.  If write is set, also make sure the
+// process may write it, and break any copy-on-write sharing.
+// pagefault() rejects pages the process has not got, both
+// below sz and in mmap() regions.
+int
+checkuser(uint va, int size, int write)
+{
+  uint a;
+  struct proc *curproc = myproc();
+
+  if(size < 0 || va >= KERNBASE || va+size > KERNBASE)
+    return -1;
+  if(va >= curproc->mm->sz && va < MMAPBASE)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va+size; a += PGSIZE)
+    if(pagefault(curproc->mm, a, write) < 0)
+      return -1;
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// to a block of memory of size bytes that the kernel will read.
+// Check that the pointer lies within the process address space.
 int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(checkuser((uint)i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, but for a block of memory that the kernel
+// will write.
+int
+argwptr(int n, char **pp, int size)
+{
+  int i;
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(checkuser((uint)i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +108,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Another thread, or another process through a MAP_SHARED region,
+// can still change the string after this check, so the kernel
+// may not see the bytes that were checked.
 int
 argstr(int n, char **pp)
 {
@@ -116,6 +154,26 @@ extern int sys_cansudo(void);
 extern int sys_addsudoer(void);
 extern int sys_removesudoer(void);
 extern int sys_setsuid(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_cpustat(void);
+extern int sys_nice(void);
+extern int sys_getpinfo(void);
+extern int sys_setshares(void);
+extern int sys_getshares(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futexwait(void);
+extern int sys_futexwake(void);
+extern int sys_lockstat(void);
+extern int sys_clockns(void);
+extern int sys_sendfile(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_poll(void);
+extern int sys_fcntl(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -150,6 +208,26 @@ static int (*syscalls[])(void) = {
 [SYS_addsudoer]     sys_addsudoer,
 [SYS_removesudoer]  sys_removesudoer,
 [SYS_setsuid]       sys_setsuid,
+[SYS_mmap]          sys_mmap,
+[SYS_munmap]        sys_munmap,
+[SYS_cpustat]       sys_cpustat,
+[SYS_nice]          sys_nice,
+[SYS_getpinfo]      sys_getpinfo,
+[SYS_setshares]     sys_setshares,
+[SYS_getshares]     sys_getshares,
+[SYS_clone]         sys_clone,
+[SYS_join]          sys_join,
+[SYS_futexwait]     sys_futexwait,
+[SYS_futexwake]     sys_futexwake,
+[SYS_lockstat]      sys_lockstat,
+[SYS_clockns]       sys_clockns,
+[SYS_sendfile]      sys_sendfile,
+[SYS_readv]         sys_readv,
+[SYS_writev]        sys_writev,
+[SYS_pread]         sys_pread,
+[SYS_pwrite]        sys_pwrite,
+[SYS_poll]          sys_poll,
+[SYS_fcntl]         sys_fcntl,
 };
 
 void
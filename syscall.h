@@ -31,3 +31,23 @@
 #define SYS_addsudoer     30
 #define SYS_removesudoer  31
 #define SYS_setsuid       32
+#define SYS_mmap          33
+#define SYS_munmap        34
+#define SYS_cpustat       35
+#define SYS_nice          36
+#define SYS_getpinfo      37
+#define SYS_setshares     38
+#define SYS_getshares     39
+#define SYS_clone         40
+#define SYS_join          41
+#define SYS_futexwait     42
+#define SYS_futexwake     43
+#define SYS_lockstat      44
+#define SYS_clockns       45
+#define SYS_sendfile      46
+#define SYS_readv         47
+#define SYS_writev        48
+#define SYS_pread         49
+#define SYS_pwrite        50
+#define SYS_poll          51
+#define SYS_fcntl         52
@@ -8,13 +8,17 @@
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
+#include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
+#include "poll.h"
 #include "fcntl.h"
+#include "mman.h"
 #include "namecache.h"
 #include "perm.h"
 
@@ -28,7 +32,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->files->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -43,14 +47,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct files *fs = myproc()->files;
 
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
@@ -75,7 +82,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -92,15 +99,120 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the nth argument, an array of cnt iovecs, into iov,
+// and check the buffers it names.  write is set if the kernel
+// will write them.
+static int
+argiov(int n, int cnt, struct iovec *iov, int write)
+{
+  struct iovec *uiov;
+  uint tot;
+  int i;
+
+  if(cnt < 0 || cnt > NIOV)
+    return -1;
+  if(argptr(n, (void*)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(*uiov));
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].len > 0x7FFFFFFF - tot)
+      return -1;
+    tot += iov[i].len;
+    if(checkuser((uint)iov[i].base, iov[i].len, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, -1);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, -1);
+}
+
+// pread(fd, buf, n, off) and pwrite(fd, buf, n, off) leave
+// the file offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argwptr(1, &p, n) < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filereadv(f, &iov, 1, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argptr(1, &p, n) < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filewritev(f, &iov, 1, off);
+}
+
+// sendfile(out, in, n): move up to n bytes from file in to
+// out inside the kernel.
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesend(out, in, n);
+}
+
 int
 sys_close(void)
 {
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  struct files *fs = myproc()->files;
+
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  // Another thread may be closing it too.
+  acquire(&fs->lock);
+  f = fs->ofile[fd];
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
+  if(f == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -111,7 +223,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -291,13 +403,15 @@ int
 sys_open(void)
 {
   char *path;
-  int fd, omode;
+  int fd, omode, nonblock;
   struct file *f;
   struct inode *ip;
   struct proc *curproc = myproc();
 
   if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
     return -1;
+  nonblock = (omode & O_NONBLOCK) != 0;
+  omode &= ~O_NONBLOCK;
 
   begin_op();
 
@@ -362,9 +476,49 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = nonblock;
   return fd;
 }
 
+// fcntl(fd, F_GETFL, 0) returns fd's O_NONBLOCK and access
+// mode; fcntl(fd, F_SETFL, flags) sets O_NONBLOCK from flags.
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETFL:
+    arg = f->nonblock ? O_NONBLOCK : 0;
+    if(f->readable && f->writable)
+      arg |= O_RDWR;
+    else if(f->writable)
+      arg |= O_WRONLY;
+    return arg;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+// Wait for any of nfds descriptors to be ready, see poll.c.
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  int nfds, timeout;
+
+  if(argint(1, &nfds) < 0 || nfds < 0 || nfds > NPOLL ||
+     argint(2, &timeout) < 0 ||
+     argwptr(0, (void*)&fds, nfds*sizeof(*fds)) < 0)
+    return -1;
+  return poll(fds, nfds, timeout);
+}
+
 int
 sys_mkdir(void)
 {
@@ -405,7 +559,7 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
+  struct inode *ip, *old;
   struct proc *curproc = myproc();
   
   begin_op();
@@ -420,9 +574,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  acquire(&curproc->files->lock);
+  old = curproc->files->cwd;
+  curproc->files->cwd = ip;
+  release(&curproc->files->lock);
+  iput(old);
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
@@ -459,14 +616,14 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      myproc()->files->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -546,3 +703,90 @@ sys_chown(void)
   
   return 0;
 }
+
+// Map len bytes of the file open as fd, starting at offset off,
+// or zero-filled memory if flags has MAP_ANONYMOUS.  The address
+// hint is ignored.  Pages are filled in when first touched.
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off, vflags;
+  uint a, va, filesz;
+  struct file *f;
+  struct inode *ip;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(!(flags & MAP_SHARED) == !(flags & MAP_PRIVATE))
+    return -1;  // need exactly one of them
+
+  vflags = 0;
+  if(prot & PROT_WRITE)
+    vflags |= VMA_WRITE;
+  if(flags & MAP_SHARED)
+    vflags |= VMA_SHARED;
+
+  ip = 0;
+  filesz = 0;
+  if(!(flags & MAP_ANONYMOUS)){
+    if(argfd(4, 0, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    if((vflags & VMA_SHARED) && (vflags & VMA_WRITE) && !f->writable)
+      return -1;
+    ilockshared(f->ip);
+    if(f->ip->type != T_FILE){
+      iunlock(f->ip);
+      return -1;
+    }
+    if(f->ip->size > off)
+      filesz = f->ip->size - off;
+    if(filesz > len)
+      filesz = len;
+    iunlock(f->ip);
+    ip = idup(f->ip);
+  }
+
+  if((a = vmaalloc(curproc->mm, PGROUNDUP((uint)len), vflags, ip, off, filesz)) == 0){
+    if(ip){
+      begin_op();
+      iput(ip);
+      end_op();
+    }
+    return -1;
+  }
+
+  // Fill in shared zero-filled memory now, so that
+  // fork children get the same pages.
+  if((vflags & VMA_SHARED) && ip == 0){
+    for(va = a; va < a + len; va += PGSIZE){
+      if(pagefault(curproc->mm, va, 0) < 0){
+        vmaunmap(curproc->mm, a, a + PGROUNDUP((uint)len));
+        return -1;
+      }
+    }
+  }
+  return a;
+}
+
+// Remove the mappings for [addr, addr+len), which must lie
+// in memory returned by mmap().
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || len <= 0)
+    return -1;
+  if((uint)addr < MMAPBASE || (uint)addr >= UINFO ||
+     (uint)addr + len > UINFO)
+    return -1;
+  return vmaunmap(myproc()->mm, addr, addr + PGROUNDUP((uint)len));
+}
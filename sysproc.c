@@ -5,7 +5,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "cpustat.h"
+#include "pstat.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -50,12 +54,54 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
 
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+int
+sys_join(void)
+{
+  uint *stack;
+
+  if(argwptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futexwait(void)
+{
+  char *addr;
+  int val, n;
+
+  if(argptr(0, &addr, sizeof(uint)) < 0 || argint(1, &val) < 0 ||
+     argint(2, &n) < 0 || n < 0)
+    return -1;
+  return futexwait((uint)addr, val, n);
+}
+
+int
+sys_futexwake(void)
+{
+  char *addr;
+  int n;
+
+  if(argptr(0, &addr, sizeof(uint)) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake((uint)addr, n);
+}
+
 int
 sys_sleep(void)
 {
@@ -71,7 +117,8 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    // Nothing else sleeps on ticks0; only the timer wakes us.
+    sleeptimeout(&ticks0, &tickslock, n - (ticks - ticks0));
   }
   release(&tickslock);
   return 0;
@@ -90,6 +137,111 @@ sys_uptime(void)
   return xticks;
 }
 
+// Copy statistics for up to n CPUs into the user's array.
+// Returns the number of CPUs.
+int
+sys_cpustat(void)
+{
+  struct cpustat *cs, cs1[NCPU];
+  struct cpu *c;
+  int n, i;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU)
+    n = NCPU;
+  if(argwptr(0, (void*)&cs, n*sizeof(*cs)) < 0)
+    return -1;
+  for(i = 0; i < n && i < ncpu; i++){
+    c = &cpus[i];
+    cs1[i].busyticks = c->busyticks;
+    cs1[i].idleticks = c->idleticks;
+    cs1[i].wakeups = c->wakeups;
+    cs1[i].wakecycles = c->wakecycles;
+    cs1[i].maxwake = c->maxwake;
+  }
+  if(copyuser(myproc()->mm, (uint)cs, (char*)cs1, i*sizeof(*cs), 1) < 0)
+    return -1;
+  return ncpu;
+}
+
+int
+sys_nice(void)
+{
+  int inc;
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  return nice(inc);
+}
+
+// Copy statistics for up to n processes into the user's array,
+// a page of them at a time.  Returns how many were copied.
+int
+sys_getpinfo(void)
+{
+  struct pstat *ps, *buf;
+  int n, i, m, want, per;
+
+  // Clamp before n*sizeof(*ps) can wrap around.
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(argwptr(0, (void*)&ps, n*sizeof(*ps)) < 0)
+    return -1;
+  if((buf = (struct pstat*)kalloc()) == 0)
+    return -1;
+  per = PGSIZE / sizeof(*buf);
+  for(i = 0; i < n; i += m){
+    want = n - i < per ? n - i : per;
+    m = getpinfo(buf, i, want);
+    if(copyuser(myproc()->mm, (uint)(ps + i), (char*)buf, m*sizeof(*buf), 1) < 0){
+      kfree((char*)buf);
+      return -1;
+    }
+    if(m < want){
+      i += m;
+      break;
+    }
+  }
+  kfree((char*)buf);
+  return i;
+}
+
+// Set the CPU share of a uid.  Only root may.
+int
+sys_setshares(void)
+{
+  int uid, n;
+
+  if(argint(0, &uid) < 0 || argint(1, &n) < 0)
+    return -1;
+  if(myproc()->uid != 0)
+    return -1;
+  return setshares(uid, n);
+}
+
+// Copy shares and usage of up to n uids into the user's array.
+// Returns how many were copied.
+int
+sys_getshares(void)
+{
+  struct ushare *us, us1[NSHARE];
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSHARE)
+    n = NSHARE;
+  if(argwptr(0, (void*)&us, n*sizeof(*us)) < 0)
+    return -1;
+  n = getshares(us1, n);
+  if(copyuser(myproc()->mm, (uint)us, (char*)us1, n*sizeof(*us), 1) < 0)
+    return -1;
+  return n;
+}
+
 
 // Системный вызов: узнать свой UID
 int
@@ -120,7 +272,10 @@ sys_setuid(void)
   if(curproc->uid != 0)
     return -1;
 
+  shareleave(curproc->uid);
+  sharejoin(uid);
   curproc->uid = uid;
+  uinfoset(curproc);
   return 0;
 }
 
@@ -139,8 +294,11 @@ sys_login(void)
     return -1;  // Неверный логин/пароль
 
   // Меняем UID текущего процесса
+  shareleave(myproc()->uid);
+  sharejoin(uid);
   myproc()->uid = uid;
   myproc()->gid = uid;
+  uinfoset(myproc());
   
   return 0;
 }
@@ -155,7 +313,7 @@ sys_whoami(void)
   if(argint(1, &size) < 0)
     return -1;
 
-  if(argptr(0, &buf, size) < 0)
+  if(argwptr(0, &buf, size) < 0)
     return -1;
 
   users_getname(myproc()->uid, buf, size);
@@ -221,6 +379,46 @@ sys_setsuid(void)
   if(uid != 0 && uid != curproc->uid)
     return -1;
   
+  shareleave(curproc->uid);
+  sharejoin(uid);
   curproc->uid = uid;
+  uinfoset(curproc);
+  return 0;
+}
+
+// Lock contention statistics, see lockstat() in spinlock.c.
+// Only root may reset them.
+int
+sys_lockstat(void)
+{
+  struct lockstat *ls, *buf;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || n < 0 || argint(2, &reset) < 0)
+    return -1;
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+  if(argwptr(0, (void*)&ls, n*sizeof(*ls)) < 0)
+    return -1;
+  if(reset && myproc()->uid != 0)
+    return -1;
+  if((buf = (struct lockstat*)kalloc()) == 0)
+    return -1;
+  n = lockstat(buf, n, reset);
+  if(copyuser(myproc()->mm, (uint)ls, (char*)buf, n*sizeof(*ls), 1) < 0)
+    n = -1;
+  kfree((char*)buf);
+  return n;
+}
+
+// Nanoseconds since boot, see nanotime() in lapic.c.
+int
+sys_clockns(void)
+{
+  uint64 *ns;
+
+  if(argwptr(0, (void*)&ns, sizeof(*ns)) < 0)
+    return -1;
+  *ns = nanotime();
   return 0;
 }
@@ -0,0 +1,140 @@
+// Kernel timers.
+//
+// Pending timers are kept in a hierarchical timing wheel:
+// NLEVEL levels of NSLOT slots each, where a slot of level l
+// covers NSLOT^l ticks.  A timer goes in the finest level
+// whose range covers its expiry.  Each tick runs the timers
+// in one slot of level 0, and every NSLOT ticks the next
+// slot of level 1 is emptied into level 0 (and so on up),
+// so adding, cancelling and firing a timer are all O(1)
+// no matter how many timers are pending.
+//
+// Interface:
+// * timeradd() arms a timer to fire after a number of ticks.
+// * timerdel() cancels it.
+// * timertick() is called once per clock tick.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define SLOTBITS 6
+#define NSLOT (1<<SLOTBITS)
+#define NLEVEL 4
+#define MAXDELAY ((1<<(SLOTBITS*NLEVEL)) - 1)
+
+struct {
+  struct spinlock lock;
+  uint now;             // last tick run by timertick()
+  struct timer *wheel[NLEVEL][NSLOT];
+} tw;
+
+void
+timerinit(void)
+{
+  initlock(&tw.lock, "timer");
+  tw.now = ticks;
+}
+
+// Put t in the slot that covers t->expire.
+// Caller must hold tw.lock.
+static void
+twinsert(struct timer *t)
+{
+  uint delta;
+  int l;
+
+  delta = t->expire - tw.now;
+  for(l = 0; l < NLEVEL-1; l++)
+    if(delta < (1 << (SLOTBITS*(l+1))))
+      break;
+  t->next = tw.wheel[l][(t->expire >> (SLOTBITS*l)) % NSLOT];
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = &tw.wheel[l][(t->expire >> (SLOTBITS*l)) % NSLOT];
+  *t->pprev = t;
+}
+
+// Take t off its slot.  Caller must hold tw.lock.
+static void
+twremove(struct timer *t)
+{
+  if(t->next)
+    t->next->pprev = t->pprev;
+  *t->pprev = t->next;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Arm t to call t->fn(t->arg) after n ticks (at least one).
+// t must not already be pending.
+void
+timeradd(struct timer *t, uint n)
+{
+  if(n < 1)
+    n = 1;
+  if(n > MAXDELAY)
+    n = MAXDELAY;
+  acquire(&tw.lock);
+  if(t->pprev)
+    panic("timeradd");
+  t->expire = tw.now + n;
+  twinsert(t);
+  release(&tw.lock);
+}
+
+// Cancel t.  Returns 1 if it was still pending, 0 if it
+// has already fired (or was never armed).  Once timerdel()
+// returns, t->fn is not running and will not run.
+int
+timerdel(struct timer *t)
+{
+  int pending;
+
+  acquire(&tw.lock);
+  pending = t->pprev != 0;
+  if(pending)
+    twremove(t);
+  release(&tw.lock);
+  return pending;
+}
+
+// Move the timers of slot i of level l down to finer levels.
+// Caller must hold tw.lock.
+static void
+cascade(int l, int i)
+{
+  struct timer *t, *next;
+
+  t = tw.wheel[l][i];
+  tw.wheel[l][i] = 0;
+  for(; t; t = next){
+    next = t->next;
+    twinsert(t);
+  }
+}
+
+// Advance the wheel by one tick and run the timers that
+// expire.  Called from the clock interrupt on one CPU.
+void
+timertick(void)
+{
+  struct timer *t;
+  int l, i;
+
+  acquire(&tw.lock);
+  tw.now++;
+  for(l = 1; l < NLEVEL; l++){
+    if((tw.now >> (SLOTBITS*(l-1))) % NSLOT != 0)
+      break;
+    i = (tw.now >> (SLOTBITS*l)) % NSLOT;
+    cascade(l, i);
+  }
+  while((t = tw.wheel[0][tw.now % NSLOT]) != 0){
+    twremove(t);
+    t->fn(t->arg);
+  }
+  release(&tw.lock);
+}
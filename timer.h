@@ -0,0 +1,8 @@
+// Kernel timers, fired from the clock interrupt (see timer.c).
+struct timer {
+  uint expire;              // value of ticks at which to fire
+  void (*fn)(void*);        // called at expiry, with timers locked
+  void *arg;
+  struct timer *next;       // wheel slot list
+  struct timer **pprev;     // 0 if not pending
+};
@@ -3,16 +3,18 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
+#include "kinfo.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+struct kinfo *kinfo;    // mapped at KINFO in every address space
 
 void
 tvinit(void)
@@ -24,6 +26,11 @@ tvinit(void)
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
 
   initlock(&tickslock, "time");
+
+  if((kinfo = (struct kinfo*)kalloc()) == 0)
+    panic("tvinit: kinfo");
+  memset(kinfo, 0, PGSIZE);
+  kinfo->tsckhz = tsckhz;
 }
 
 void
@@ -32,30 +39,66 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Set up this cpu for system calls by sysenter (see
+// trapasm.S).  The entry stack is this cpu's ts.esp0,
+// which switchuvm() points at the current process's
+// kernel stack, so the MSRs need not change per process.
+void
+sysenterinit(void)
+{
+  extern char sysentry[];
+
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+  wrmsr(MSR_SYSENTER_ESP, (uint)&mycpu()->ts.esp0);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  int r;
+  uint cr2;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
+    myproc()->insyscall = 1;
     syscall();
+    myproc()->insyscall = 0;
     if(myproc()->killed)
       exit();
     return;
   }
 
+  // A fault taken once interrupts are back on would
+  // overwrite %cr2.
+  cr2 = rcr2();
+
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    if(mycpu()->proc)
+      mycpu()->busyticks++;
+    else
+      mycpu()->idleticks++;
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
+      kinfo->ticks = ticks;
       release(&tickslock);
+      timertick();
     }
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_TLB:
+    tlbintr();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Just wakes the CPU; see kick() in proc.c.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -77,20 +120,35 @@ trap(struct trapframe *tf)
             cpuid(), tf->cs, tf->eip);
     lapiceoi();
     break;
+  case T_PGFLT:
+    // Lazily mapped or copy-on-write page; the kernel
+    // takes these too when it touches user memory.
+    if(myproc() != 0){
+      // Let other CPUs' TLB shootdowns in while we wait
+      // for the address space; see tlbshootdown().
+      if(mycpu()->ncli == 0)
+        sti();
+      myproc()->pinned++;
+      r = pagefault(myproc()->mm, cr2, tf->err & FEC_WR);
+      myproc()->pinned--;
+      if(r == 0)
+        break;
+    }
+    // fall through
 
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
-              tf->trapno, cpuid(), tf->eip, rcr2());
+              tf->trapno, cpuid(), tf->eip, cr2);
       panic("trap");
     }
     // In user space, assume process misbehaved.
     cprintf("pid %d %s: trap %d err %d on cpu %d "
             "eip 0x%x addr 0x%x--kill proc\n",
             myproc()->pid, myproc()->name, tf->trapno,
-            tf->err, cpuid(), tf->eip, rcr2());
+            tf->err, cpuid(), tf->eip, cr2);
     myproc()->killed = 1;
   }
 
@@ -100,10 +158,12 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU at the end of its time slice,
+  // or when a process of higher priority is waiting for it.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     (tf->trapno == T_IRQ0+IRQ_TIMER || tf->trapno == T_IRQ0+IRQ_RESCHED) &&
+     shouldyield(tf->trapno == T_IRQ0+IRQ_TIMER))
     yield();
 
   // Check if the process has been killed since we yielded
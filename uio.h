@@ -0,0 +1,7 @@
+// Buffers for readv() and writev().
+struct iovec {
+  void *base;
+  uint len;
+};
+
+#define NIOV 16  // most buffers in one call
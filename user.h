@@ -1,5 +1,14 @@
 struct stat;
 struct rtcdate;
+struct cpustat;
+struct pstat;
+struct ushare;
+struct mutex;
+struct cond;
+struct sem;
+struct lockstat;
+struct iovec;
+struct pollfd;
 
 // system calls
 int fork(void);
@@ -19,12 +28,12 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
+int sysgetpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
-int getuid(void);
-int getgid(void);
+int sysuptime(void);
+int sysgetuid(void);
+int sysgetgid(void);
 int setuid(int);
 int login(char*, char*);
 int whoami(char*, int);
@@ -34,6 +43,26 @@ int cansudo(void);
 int addsudoer(int);
 int removesudoer(int);
 int setsuid(int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int cpustat(struct cpustat*, int);
+int nice(int);
+int getpinfo(struct pstat*, int);
+int setshares(int, int);
+int getshares(struct ushare*, int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futexwait(volatile uint*, uint, uint);
+int futexwake(volatile uint*, int);
+int lockstat(struct lockstat*, int, int);
+int clockns(uint64*);
+int sendfile(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -48,3 +77,25 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int getpid(void);
+int uptime(void);
+int getuid(void);
+int getgid(void);
+uint64 nsec(void);
+uint64 cycles(void);
+uint cyc2ns(uint);
+
+// uthread.c
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void sem_init(struct sem*, uint);
+void sem_wait(struct sem*);
+void sem_post(struct sem*);
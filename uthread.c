@@ -0,0 +1,187 @@
+// User-level threads, on top of clone() and join().
+//
+// thread_create() runs fn(arg) in a new thread with its own
+// stack from malloc(); thread_join() waits for a thread to
+// finish and frees its stack.  malloc() is not thread-safe,
+// so only one thread should create and join threads.
+//
+// Mutexes, condition variables and semaphores keep their
+// state in a word changed with atomic instructions, and
+// call futexwait() and futexwake() only to block and to
+// wake a blocked thread.  Uncontended operations do not
+// enter the kernel.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+
+#define TSTACKSIZE (4*4096)
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static void
+tstart(void *v)
+{
+  struct tstart *t = v;
+
+  t->fn(t->arg);
+  exit();
+}
+
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *stack;
+  struct tstart *t;
+  int pid;
+
+  if((stack = malloc(TSTACKSIZE)) == 0)
+    return -1;
+  // The start record goes at the top of the stack,
+  // and the stack grows down from it.
+  t = (struct tstart*)(stack + TSTACKSIZE) - 1;
+  t->fn = fn;
+  t->arg = arg;
+  if((pid = clone(tstart, t, t)) < 0){
+    free(stack);
+    return -1;
+  }
+  return pid;
+}
+
+int
+thread_join(void)
+{
+  void *top;
+  int pid;
+
+  if((pid = join(&top)) < 0)
+    return -1;
+  free((char*)top + sizeof(struct tstart) - TSTACKSIZE);
+  return pid;
+}
+
+// Mutex, after Drepper's "Futexes Are Tricky".
+// state is 0 when free, 1 when held, and 2 when held and
+// some thread may be waiting, so that unlock knows whether
+// it has to call futexwake().
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)
+    return;
+  // Contended: announce a waiter, and sleep until
+  // the lock is free when we grab it.
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futexwait(&m->state, 2, 0);
+    c = xchg(&m->state, 2);
+  }
+}
+
+// Returns 0 if the lock was taken, -1 if it is held.
+int
+mutex_trylock(struct mutex *m)
+{
+  return cmpxchg(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futexwake(&m->state, 1);
+}
+
+// Condition variable.  A waiter notes seq before releasing
+// the mutex and sleeps only if no signal has bumped it since.
+// Waiters are counted so that a signal with no one waiting
+// stays in user space; since both counters change with
+// locked instructions, either the signaller sees the waiter
+// or the waiter sees the new seq.
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  xadd(&c->waiters, 1);
+  seq = c->seq;
+  mutex_unlock(m);
+  futexwait(&c->seq, seq, 0);
+  xadd(&c->waiters, -1);
+  // Other waiters may have been woken with us,
+  // so take the mutex as contended.
+  while(xchg(&m->state, 2) != 0)
+    futexwait(&m->state, 2, 0);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  if(c->waiters)
+    futexwake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  if(c->waiters)
+    futexwake(&c->seq, 0x7fffffff);
+}
+
+// Counting semaphore.  Waiters sleep only while count is 0.
+
+void
+sem_init(struct sem *s, uint n)
+{
+  s->count = n;
+  s->waiters = 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+  uint c;
+
+  for(;;){
+    while((c = s->count) != 0)
+      if(cmpxchg(&s->count, c, c-1) == c)
+        return;
+    xadd(&s->waiters, 1);
+    futexwait(&s->count, 0, 0);
+    xadd(&s->waiters, -1);
+  }
+}
+
+void
+sem_post(struct sem *s)
+{
+  xadd(&s->count, 1);
+  if(s->waiters)
+    futexwake(&s->count, 1);
+}
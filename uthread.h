@@ -0,0 +1,17 @@
+// User-level synchronization, see uthread.c.
+// Zero-filled structures are ready to use, like the
+// ones the *_init() functions produce.
+
+struct mutex {
+  volatile uint state;   // 0 free, 1 held, 2 held with waiters
+};
+
+struct cond {
+  volatile uint seq;     // bumped by every signal
+  volatile uint waiters;
+};
+
+struct sem {
+  volatile uint count;
+  volatile uint waiters;
+};
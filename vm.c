@@ -4,8 +4,11 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
+#include "kinfo.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -42,7 +45,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    if(!alloc || (pgtab = (pte_t*)kallocswap()) == 0)
       return 0;
     // Make sure all those PTE_P bits are zero.
     memset(pgtab, 0, PGSIZE);
@@ -88,17 +91,25 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // setupkvm() and exec() set up every page table like this:
 //
 //   0..KERNBASE: user memory (text+data+stack+heap), mapped to
-//                phys memory allocated by the kernel
+//                phys memory allocated by the kernel; the top
+//                two pages are the info pages (kinfo.h)
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (phystop, found
+// at boot and at most PHYSTOP)
+// (directly addressable from end..P2V(phystop)).
+//
+// The kernel half is built once, in kpgdir, using 4Mbyte pages
+// wherever alignment allows.  Every other page directory copies
+// kpgdir's kernel entries, so all address spaces share the kernel's
+// page tables.  Kernel mappings are global (PTE_G), so switching
+// page tables does not flush them from the TLB.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -110,37 +121,71 @@ static struct kmap {
 } kmap[] = {
  { (void*)KERNBASE, 0,             EXTMEM,    PTE_W}, // I/O space
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
- { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
+ { (void*)data,     V2P(data),     0,         PTE_W}, // kern data+memory
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
+// Map size bytes of kernel address space starting at va to
+// physical addresses starting at pa, using a 4Mbyte page for
+// each aligned 4Mbyte piece and 4Kbyte pages for the rest.
+static int
+kmappages(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  pte_t *pte;
+  uint n;
+
+  while(size > 0){
+    if(va % SPGSIZE == 0 && pa % SPGSIZE == 0 && size >= SPGSIZE){
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS | PTE_G;
+      n = SPGSIZE;
+    } else {
+      if((pte = walkpgdir(pgdir, (void*)va, 1)) == 0)
+        return -1;
+      if(*pte & PTE_P)
+        panic("remap");
+      *pte = pa | perm | PTE_P | PTE_G;
+      n = PGSIZE;
+    }
+    va += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // Set up kernel part of a page table.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
-// Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// Build the kernel page table shared by every address space,
+// and switch to it.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  kmap[2].phys_end = phystop;  // known only at boot
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(kmappages(kpgdir, (uint)k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc");
   switchkvm();
 }
 
@@ -160,7 +205,7 @@ switchuvm(struct proc *p)
     panic("switchuvm: no process");
   if(p->kstack == 0)
     panic("switchuvm: no kstack");
-  if(p->pgdir == 0)
+  if(p->mm == 0 || p->mm->pgdir == 0)
     panic("switchuvm: no pgdir");
 
   pushcli();
@@ -173,7 +218,7 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  lcr3(V2P(p->mm->pgdir));  // switch to process's address space
   popcli();
 }
 
@@ -192,30 +237,6 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,7 +252,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kallocswap();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -273,13 +294,38 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if((*pte & PTE_SWAP) != 0){
+      swapfree(PTE_ADDR(*pte) >> PTXSHIFT);
+      *pte = 0;
+    } else if(PTE_ADDR(*pte) != 0){
+      // Unmapped by unmapuvm().
+      kfree(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
     }
   }
   return newsz;
 }
 
+// Make the pages in [start, end) not present, but keep them
+// for deallocuvm() to free, so that other CPUs' TLBs can be
+// flushed (see tlbshootdown()) before the memory is reused.
+void
+unmapuvm(pde_t *pgdir, uint start, uint end)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDUP(start); a < end; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(*pte & PTE_P)
+      *pte &= ~PTE_P;
+  }
+}
+
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part belongs to kpgdir.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,7 +334,7 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -310,37 +356,78 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// Read the paged-out page that *pte describes back in.
+static int
+swapin(pte_t *pte)
+{
+  char *mem;
+  uint s;
+
+  if((mem = kallocswap()) == 0)
+    return -1;
+  s = PTE_ADDR(*pte) >> PTXSHIFT;
+  swapread(s, mem);
+  swapfree(s);
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P;
+  return 0;
+}
+
+// Copy the page at va, if present, from pgdir to d.
+// Read-only pages, and pages of shared regions, are
+// shared rather than copied.
+static int
+copypage(pde_t *d, pde_t *pgdir, uint va, int shared)
 {
-  pde_t *d;
   pte_t *pte;
-  uint pa, i, flags;
+  uint pa, flags;
   char *mem;
 
-  if((d = setupkvm()) == 0)
+  if((pte = walkpgdir(pgdir, (void *) va, 0)) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+  if((*pte & PTE_SWAP) && swapin(pte) < 0)
+    return -1;
+  if(!(*pte & PTE_P))
+    return 0;
+  pa = PTE_ADDR(*pte);
+  flags = PTE_FLAGS(*pte);
+  if(shared || (flags & (PTE_U|PTE_W)) == PTE_U){
+    // Parent and child can use the same page.
+    if(mappages(d, (void*)va, PGSIZE, pa, flags) < 0)
+      return -1;
+    kdup(P2V(pa));
+    return 0;
+  }
+  if((mem = kallocswap()) == 0)
+    return -1;
+  memmove(mem, (char*)P2V(pa), PGSIZE);
+  if(mappages(d, (void*)va, PGSIZE, V2P(mem), flags) < 0) {
+    kfree(mem);
+    return -1;
   }
-  return d;
+  return 0;
+}
 
-bad:
-  freevm(d);
+// Given a parent process's page table, copy it into the
+// empty page table d for a child: memory below sz, and the
+// regions in vma[] that lie above it.  Pages not yet faulted
+// in stay that way.  On failure, d holds part of the copy,
+// for the caller to free.
+int
+copyuvm(pde_t *d, pde_t *pgdir, uint sz, struct vma *vma)
+{
+  struct vma *v;
+  uint i;
+
+  for(i = 0; i < sz; i += PGSIZE)
+    if(copypage(d, pgdir, i, 0) < 0)
+      return -1;
+  for(v = vma; v < &vma[NVMA]; v++){
+    if(v->start < sz)
+      continue;
+    for(i = v->start; i < v->end; i += PGSIZE)
+      if(copypage(d, pgdir, i, v->flags & VMA_SHARED) < 0)
+        return -1;
+  }
   return 0;
 }
 
@@ -352,7 +439,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -386,9 +473,559 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 }
 
 //PAGEBREAK!
-// Blank page.
-//PAGEBREAK!
-// Blank page.
+// Lazily mapped regions.
+//
+// exec() does not read a program into memory.  It records
+// each segment as a vma, and pagefault() fills in a page
+// the first time the process touches it.  Pages that hold
+// nothing but file content come straight from the page
+// cache and are mapped read-only, so all processes running
+// the same program share them; a process that writes to
+// one gets its own copy.
+//
+// mmap() adds regions above MMAPBASE.  A shared file region
+// maps page cache pages writable, so every process mapping
+// the file sees the same bytes, and dirty pages are written
+// back to the file by munmap(), exec() and exit().
+
+// Return the region of mm containing va, or 0.
+struct vma*
+vmalookup(struct mm *mm, uint va)
+{
+  struct vma *v;
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Release the regions in vma[0..NVMA-1].
+// Must be called inside a transaction since it calls iput().
+void
+vmafree(struct vma *vma)
+{
+  struct vma *v;
+
+  for(v = vma; v < &vma[NVMA]; v++){
+    if(v->ip)
+      iput(v->ip);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Map the page at a, inside region v, which is not yet present.
+static int
+vmafill(pde_t *pgdir, struct vma *v, uint a)
+{
+  char *mem;
+  uint off, n;
+  int perm, share;
+
+  perm = PTE_U;
+  if(v->flags & VMA_WRITE)
+    perm |= PTE_W;
+  off = a - v->start;
+
+  // A page can come from the page cache if it is all file
+  // content, or if it is the read-only tail of a region
+  // with nothing after the file content.
+  share = 0;
+  if(v->ip && off < v->filesz){
+    if(off + PGSIZE <= v->filesz || (v->flags & VMA_SHARED))
+      share = 1;
+    else if(!(v->flags & VMA_WRITE) && PGROUNDUP(v->filesz) == v->end - v->start)
+      share = 1;
+  }
+
+  if(share){
+    ilockshared(v->ip);
+    mem = pcacheget(v->ip, v->off + off, v->flags & VMA_SHARED);
+    iunlock(v->ip);
+    if(mem == 0)
+      return -1;
+    if(!(v->flags & VMA_SHARED))
+      perm &= ~PTE_W;
+  } else {
+    if((mem = kallocswap()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(v->ip && off < v->filesz){
+      n = v->filesz - off;
+      ilockshared(v->ip);
+      if(readi(v->ip, mem, v->off + off, n) != n){
+        iunlock(v->ip);
+        kfree(mem);
+        return -1;
+      }
+      iunlock(v->ip);
+    }
+  }
+  if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Handle a fault on user address va in address space mm,
+// either because the page has not been filled in yet, because
+// it has been paged out, or because the process wants to
+// write a shared read-only page.  Caller must hold mmlock(mm).
+static int
+pagefault1(struct mm *mm, uint va, int write)
+{
+  pte_t *pte;
+  struct vma *v;
+  char *mem;
+  uint a, pa;
+
+  a = PGROUNDDOWN(va);
+  pte = walkpgdir(mm->pgdir, (char*)a, 0);
+  if(pte && (*pte & PTE_SWAP) && swapin(pte) < 0)
+    return -1;
+  if(pte && (*pte & PTE_P)){
+    if((*pte & PTE_U) == 0)
+      return -1;  // guard page
+    if(!write || (*pte & PTE_W))
+      return 0;
+    // Copy on write.
+    if((v = vmalookup(mm, a)) == 0 || (v->flags & VMA_WRITE) == 0)
+      return -1;
+    pa = PTE_ADDR(*pte);
+    if(krefcnt(P2V(pa)) == 1){
+      // No one else has it any more.
+      *pte |= PTE_W;
+      invlpg((void*)a);
+    } else {
+      if((mem = kallocswap()) == 0)
+        return -1;
+      memmove(mem, P2V(pa), PGSIZE);
+      *pte = V2P(mem) | PTE_FLAGS(*pte) | PTE_W;
+      // Other threads must stop using the old page
+      // before it can be freed.
+      tlbshootdown(mm);
+      kfree(P2V(pa));
+    }
+    return 0;
+  }
+
+  if((v = vmalookup(mm, a)) == 0)
+    return -1;
+  if(write && (v->flags & VMA_WRITE) == 0)
+    return -1;
+  return vmafill(mm->pgdir, v, a);
+}
+
+// Handle a page fault at va in mm.
+// Returns 0 if the access can be retried, -1 if it is
+// a real fault.
+int
+pagefault(struct mm *mm, uint va, int write)
+{
+  int r;
+
+  if(va >= KERNBASE)
+    return -1;
+  mmlock(mm);
+  r = pagefault1(mm, va, write);
+  mmunlock(mm);
+  return r;
+}
+
+// Copy n bytes between user address va in mm and kernel
+// buffer buf, into user memory if write is set.  Holds the
+// mm lock, so no other thread can unmap the pages, and goes
+// through the kernel's mapping of each page, so it never
+// faults.  For callers that cannot trust a checkuser() made
+// earlier.  Returns 0, or -1 if mm does not have the pages.
+int
+copyuser(struct mm *mm, uint va, char *buf, uint n, int write)
+{
+  uint a, m;
+  char *ka;
+
+  if(va + n < va || va + n > KERNBASE)
+    return -1;
+  mmlock(mm);
+  while(n > 0){
+    a = PGROUNDDOWN(va);
+    if(pagefault1(mm, a, write) < 0 ||
+       (ka = uva2ka(mm->pgdir, (char*)a)) == 0){
+      mmunlock(mm);
+      return -1;
+    }
+    m = PGSIZE - (va - a);
+    if(m > n)
+      m = n;
+    if(write)
+      memmove(ka + (va - a), buf, m);
+    else
+      memmove(buf, ka + (va - a), m);
+    buf += m;
+    va += m;
+    n -= m;
+  }
+  mmunlock(mm);
+  return 0;
+}
+
+
+// Record a new region of len bytes in mm, somewhere between
+// MMAPBASE and UINFO.  Takes over the caller's reference
+// to ip.  Returns the region's start, or 0 if there is no room.
+uint
+vmaalloc(struct mm *mm, uint len, int flags, struct inode *ip,
+         uint off, uint filesz)
+{
+  struct vma *v, *nv;
+  uint a;
+
+  mmlock(mm);
+  for(nv = mm->vma; nv < &mm->vma[NVMA]; nv++)
+    if(nv->start == nv->end)
+      break;
+  if(nv == &mm->vma[NVMA]){
+    mmunlock(mm);
+    return 0;
+  }
+
+  // First fit.
+  for(a = MMAPBASE; ; a = v->end){
+    if(a + len < a || a + len > UINFO){
+      mmunlock(mm);
+      return 0;
+    }
+    for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+      if(v->start < a + len && a < v->end)
+        break;
+    if(v == &mm->vma[NVMA])
+      break;
+  }
+
+  nv->start = a;
+  nv->end = a + len;
+  nv->flags = flags;
+  nv->ip = ip;
+  nv->off = off;
+  nv->filesz = filesz;
+  mmunlock(mm);
+  return a;
+}
+
+// If the page at a is a dirty page of a shared file
+// region, write it back to the file.
+static void
+vmawriteback(pde_t *pgdir, struct vma *v, uint a)
+{
+  pte_t *pte;
+  uint off, n;
+
+  if(!(v->flags & VMA_SHARED) || v->ip == 0)
+    return;
+  pte = walkpgdir(pgdir, (char*)a, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_D)) != (PTE_P|PTE_D))
+    return;
+  off = a - v->start;
+  if(off >= v->filesz)
+    return;
+  n = v->filesz - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  begin_op();
+  ilock(v->ip);
+  writei(v->ip, P2V(PTE_ADDR(*pte)), v->off + off, n);
+  iunlock(v->ip);
+  end_op();
+}
+
+// Remove [start, end) from mm's regions, writing back
+// shared pages and freeing the memory.  start and end
+// must be page aligned.  Returns -1, changing nothing,
+// if a region would have to be split and there is no
+// slot for the second half.
+int
+vmaunmap(struct mm *mm, uint start, uint end)
+{
+  struct vma *v, *nv;
+  uint lo, hi, a;
+
+  mmlock(mm);
+  nv = 0;
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++){
+    if(v->start < start && end < v->end){
+      for(nv = mm->vma; nv < &mm->vma[NVMA]; nv++)
+        if(nv->start == nv->end)
+          break;
+      if(nv == &mm->vma[NVMA]){
+        mmunlock(mm);
+        return -1;
+      }
+    }
+  }
+
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++){
+    if(v->start == v->end || v->end <= start || end <= v->start)
+      continue;
+    lo = v->start > start ? v->start : start;
+    hi = v->end < end ? v->end : end;
+    for(a = lo; a < hi; a += PGSIZE)
+      vmawriteback(mm->pgdir, v, a);
+    // Stop other threads using the pages before freeing them.
+    unmapuvm(mm->pgdir, lo, hi);
+    tlbshootdown(mm);
+    deallocuvm(mm->pgdir, hi, lo);
+
+    if(lo == v->start && hi == v->end){
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      memset(v, 0, sizeof(*v));
+    } else if(lo == v->start){
+      v->off += hi - v->start;
+      v->filesz = v->filesz > hi - v->start ? v->filesz - (hi - v->start) : 0;
+      v->start = hi;
+    } else {
+      if(hi != v->end){
+        // Keep [hi, end) in nv.
+        *nv = *v;
+        nv->start = hi;
+        nv->off += hi - v->start;
+        nv->filesz = v->filesz > hi - v->start ? v->filesz - (hi - v->start) : 0;
+        if(nv->ip)
+          idup(nv->ip);
+      }
+      v->end = lo;
+      if(v->filesz > lo - v->start)
+        v->filesz = lo - v->start;
+    }
+  }
+  mmunlock(mm);
+  return 0;
+}
+
+// Look for a page of mm to page out, starting at *va, for
+// swapout()'s CLOCK sweep.  Clears the accessed bit of the
+// pages passed over.  Points the victim's PTE at swap slot s,
+// sets *va just past it, and returns its physical address;
+// returns 0 at the end of mm's memory.  Only private pages
+// are taken; pages shared with other page tables or the
+// page cache stay put.  No thread may be running in mm.
+uint
+pagevictim(struct mm *mm, uint *va, uint s)
+{
+  pde_t *pde;
+  pte_t *pte;
+  struct vma *v;
+  uint a, pa;
+
+  for(a = *va; a < UINFO; a += PGSIZE){
+    pde = &mm->pgdir[PDX(a)];
+    if(!(*pde & PTE_P)){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(a)];
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if(krefcnt(P2V(PTE_ADDR(*pte))) != 1)
+      continue;
+    if((v = vmalookup(mm, a)) != 0 && (v->flags & VMA_SHARED))
+      continue;
+    // mm is not running, so no TLB holds the old mapping.
+    pa = PTE_ADDR(*pte);
+    *pte = (s << PTXSHIFT) | (PTE_FLAGS(*pte) & ~PTE_P) | PTE_SWAP;
+    *va = a + PGSIZE;
+    return pa;
+  }
+  return 0;
+}
+
 //PAGEBREAK!
-// Blank page.
+// Address spaces.
+//
+// An mm holds a page table and the regions mapped in it.
+// Each process has one; the threads made by clone() share
+// their parent's.  users counts live threads: the last one
+// to exit releases the regions.  ref counts procs, zombies
+// included: the last one to be reaped frees the page table,
+// which an exiting thread is still running on.
+
+// Allocate an empty address space.  kalloc() is the only
+// allocator, so an mm gets a whole page.  The info pages are
+// mapped read-only from the start; freevm() frees them.
+struct mm*
+mmalloc(void)
+{
+  struct mm *mm;
+  char *u;
+
+  if((mm = (struct mm*)kalloc()) == 0)
+    return 0;
+  memset(mm, 0, sizeof(*mm));
+  if((mm->pgdir = setupkvm()) == 0){
+    kfree((char*)mm);
+    return 0;
+  }
+  if((u = kalloc()) == 0)
+    goto bad;
+  memset(u, 0, PGSIZE);
+  if(mappages(mm->pgdir, (void*)UINFO, PGSIZE, V2P(u), PTE_U) < 0){
+    kfree(u);
+    goto bad;
+  }
+  kdup((char*)kinfo);
+  if(mappages(mm->pgdir, (void*)KINFO, PGSIZE, V2P(kinfo), PTE_U) < 0){
+    kfree((char*)kinfo);
+    goto bad;
+  }
+  mm->uinfo = (struct uinfo*)u;
+  initlock(&mm->lk, "mm");
+  mm->users = 1;
+  mm->ref = 1;
+  return mm;
+
+bad:
+  freevm(mm->pgdir);
+  kfree((char*)mm);
+  return 0;
+}
+
+// Publish p's pid, uid and gid in its address space's
+// uinfo page.  Once threads share the space, the page no
+// longer says whose it is: pid 0 sends readers to the kernel.
+// mm->lk orders this against threads coming and going.
+void
+uinfoset(struct proc *p)
+{
+  struct uinfo *u;
+
+  u = p->mm->uinfo;
+  acquire(&p->mm->lk);
+  if(p->mm->users > 1)
+    u->pid = 0;
+  else {
+    u->uid = p->uid;
+    u->gid = p->gid;
+    u->pid = p->pid;
+  }
+  release(&p->mm->lk);
+}
+
+// Add a thread to mm.
+void
+mmdup(struct mm *mm)
+{
+  acquire(&mm->lk);
+  mm->users++;
+  mm->ref++;
+  release(&mm->lk);
+}
+
+// A thread is done with mm; the last one releases its regions,
+// writing back shared file pages.  Must not be called inside
+// a transaction.
+void
+mmexit(struct mm *mm)
+{
+  int users;
+
+  acquire(&mm->lk);
+  users = --mm->users;
+  release(&mm->lk);
+  if(users == 1)
+    mmsingle(mm);
+  if(users > 0)
+    return;
+  vmaunmap(mm, MMAPBASE, KERNBASE);
+  begin_op();
+  vmafree(mm->vma);
+  end_op();
+}
+
+// Drop a proc's reference to mm, freeing it with the last.
+// mm must not be the current page table.
+void
+mmput(struct mm *mm)
+{
+  int ref;
+
+  acquire(&mm->lk);
+  ref = --mm->ref;
+  release(&mm->lk);
+  if(ref > 0)
+    return;
+  freevm(mm->pgdir);
+  kfree((char*)mm);
+}
 
+// Serialize changes to mm: faults, growth, mmap.
+// Long-term, like a sleeplock.
+void
+mmlock(struct mm *mm)
+{
+  acquire(&mm->lk);
+  while(mm->locked)
+    sleep(mm, &mm->lk);
+  mm->locked = 1;
+  release(&mm->lk);
+}
+
+void
+mmunlock(struct mm *mm)
+{
+  acquire(&mm->lk);
+  mm->locked = 0;
+  wakeup(mm);
+  release(&mm->lk);
+}
+
+// Flush mm's mappings from the TLB of every CPU running it,
+// after PTEs have been removed or write-protected, and wait
+// until they have done it.  Must be called with interrupts
+// enabled or at least no spinlock held, since another CPU
+// may be waiting for this one in the same way.
+void
+tlbshootdown(struct mm *mm)
+{
+  struct cpu *c;
+  struct proc *p;
+  uint want[NCPU];
+  int i;
+
+  pushcli();
+  if(myproc() && myproc()->mm == mm)
+    lcr3(V2P(mm->pgdir));
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[i];
+    want[i] = 0;
+    // A CPU that starts running mm after this loads
+    // the new page table anyway.
+    if(c == mycpu() || (p = c->proc) == 0 || p->mm != mm)
+      continue;
+    want[i] = __sync_add_and_fetch(&c->tlbreq, 1);
+    lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+  }
+  popcli();
+  for(i = 0; i < ncpu; i++)
+    if(want[i])
+      while((int)(cpus[i].tlbdone - want[i]) < 0)
+        ;
+}
+
+// TLB shootdown interrupt; see tlbshootdown().
+void
+tlbintr(void)
+{
+  uint req;
+
+  req = mycpu()->tlbreq;
+  lcr3(rcr3());
+  mycpu()->tlbdone = req;
+}
@@ -117,6 +117,46 @@ sti(void)
   asm volatile("sti");
 }
 
+static inline void
+hlt(void)
+{
+  asm volatile("hlt");
+}
+
+// Low 32 bits of the time-stamp counter.
+static inline uint
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return lo;
+}
+
+// The whole time-stamp counter.
+static inline uint64
+rdtsc64(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+// Divide n by d, which must be more than n>>32 so the
+// quotient fits in 32 bits.  There is no libgcc for
+// 64-bit division.
+static inline uint
+divl(uint64 n, uint d, uint *rem)
+{
+  uint q, r;
+
+  asm("divl %4" : "=a" (q), "=d" (r) : "a" ((uint)n),
+      "d" ((uint)(n >> 32)), "rm" (d));
+  *rem = r;
+  return q;
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +170,45 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+static inline void
+wrmsr(uint msr, uint val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+// Spin-wait hint: lets a hyperthread sibling run and
+// avoids a memory-order flush when the spin ends.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Atomically set *addr to newval if it holds old.
+// Returns the value *addr held.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc");
+  return result;
+}
+
+// Atomically add n to *addr.  Returns the old value.
+static inline uint
+xadd(volatile uint *addr, uint n)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "cc");
+  return n;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -138,12 +217,26 @@ rcr2(void)
   return val;
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 static inline void
 lcr3(uint val)
 {
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().